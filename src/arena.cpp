@@ -0,0 +1,62 @@
+#include "arena.hpp"
+
+#include <iostream>
+
+using namespace std;
+
+Arena::Arena(size_t blockSize_in)
+	: next(NULL), end(NULL), blockSize(blockSize_in), used(0), reserved(0)
+{}
+
+Arena::~Arena() {
+	release();
+}
+
+void *Arena::allocateSlow(size_t size) {
+
+	// big requests get a block of their own so the current block isn't wasted
+	size_t want = blockSize;
+	if(size > blockSize / 4) {
+		want = size;
+	}
+
+	char *block = (char *)malloc(want);
+	if(block == NULL) {
+		cerr << "out of memory" << endl;
+		exit(1);
+	}
+	blocks.push_back(block);
+	reserved = reserved + want;
+	used = used + size;
+
+	if(want == size) {
+		return block;
+	}
+
+	next = block + size;
+	end = block + want;
+	return block;
+}
+
+void Arena::release() {
+	for(unsigned int i = 0; i < blocks.size(); i++) {
+		free(blocks[i]);
+	}
+	blocks.clear();
+	next = NULL;
+	end = NULL;
+	used = 0;
+	reserved = 0;
+}
+
+size_t Arena::bytesUsed() const {
+	return used;
+}
+
+size_t Arena::bytesReserved() const {
+	return reserved;
+}
+
+unsigned int Arena::blockCount() const {
+	return blocks.size();
+}
@@ -0,0 +1,77 @@
+#ifndef arena_hpp
+#define arena_hpp
+
+#include <vector>
+#include <cstddef>
+#include <stdlib.h>
+
+// Bump allocator owned by one translation unit. Everything allocated from it
+// is released together by release() (or the destructor); nothing is freed one by one.
+class Arena {
+private:
+	std::vector<char *> blocks;
+	char *next;
+	char *end;
+	size_t blockSize;
+
+	size_t used;														// bytes handed out
+	size_t reserved;													// bytes obtained from malloc
+
+	void *allocateSlow(size_t size);
+
+public:
+	Arena(size_t blockSize_in = 64 * 1024);
+	~Arena();
+
+	void *allocate(size_t size) {
+		size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		if((size_t)(end - next) < size) {
+			return allocateSlow(size);
+		}
+		void *p = next;
+		next = next + size;
+		used = used + size;
+		return p;
+	}
+
+	void release();
+
+	size_t bytesUsed() const;
+	size_t bytesReserved() const;
+	unsigned int blockCount() const;
+
+};
+
+// lets containers inside AST nodes draw from the same arena
+template <typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+
+	Arena *arena;
+
+	ArenaAllocator(Arena &arena_in) : arena(&arena_in) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+	T *allocate(size_t n) {
+		return (T *)arena->allocate(n * sizeof(T));
+	}
+
+	void deallocate(T *p, size_t n) {}
+
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+	return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+	return a.arena != b.arena;
+}
+
+
+#endif
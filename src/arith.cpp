@@ -0,0 +1,224 @@
+#include "arith.hpp"
+
+#include <vector>
+
+using namespace std;
+
+// cycles from issuing mult to having the product in a register with mflo
+static const unsigned int MULT_CYCLES = 12;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// MULTIPLICATION
+
+// x * 2^shift, added or subtracted
+struct Term {
+	unsigned int shift;
+	bool negative;
+};
+
+// c as a sum of powers of two with as few nonzero digits as there can be,
+// working modulo 2^32 like the multiplication itself
+static vector<Term> signedDigits(int c) {
+	vector<Term> terms;
+	unsigned long long v = (unsigned int)c;
+	for(unsigned int k = 0; v != 0 && k < 32; k++, v = v >> 1) {
+		if(v & 1) {
+			// ...01 takes a 1 here, ...11 a -1 and carries into the next digit
+			Term t = {k, (v & 3) == 3};
+			terms.push_back(t);
+			v = t.negative ? v + 1 : v - 1;
+		}
+	}
+	return terms;
+}
+
+// instructions to load c with li
+static unsigned int loadCost(int c) {
+	return (fitsSigned(c) || fitsUnsigned(c) || (c & 0xffff) == 0) ? 1 : 2;
+}
+
+void multiplyByConstant(MachineFunction &fn, unsigned int dest, unsigned int x, int c) {
+
+	vector<Term> terms = signedDigits(c);
+
+	// start from a positive term so nothing needs negating at the end
+	unsigned int base = 0;
+	while(base < terms.size() && terms[base].negative) {
+		base++;
+	}
+
+	unsigned int cost = 0;
+	for(unsigned int t = 0; t < terms.size(); t++) {
+		// shift, then add it on unless it is the one the sum starts from
+		cost = cost + ((terms[t].shift > 0) ? 1 : 0) + ((t != base) ? 1 : 0);
+	}
+	if(base < terms.size() && terms[base].shift == 0) {
+		// starting from x itself is a move
+		cost++;
+	}
+
+	if(terms.empty()) {
+		fn.emit(I_MOVE, dest, REG_ZERO);
+		return;
+	}
+
+	if(cost >= MULT_CYCLES + loadCost(c)) {
+		unsigned int factor = fn.newRegister();
+		fn.emit(I_LI, factor, 0, 0, c);
+		fn.emit(I_MULT, 0, x, factor);
+		fn.emit(I_MFLO, dest);
+		return;
+	}
+
+	// the sum so far, $0 if every term is negative
+	if(base < terms.size()) {
+		if(terms[base].shift > 0) {
+			fn.emit(I_SLL, dest, x, 0, terms[base].shift);
+		} else {
+			fn.emit(I_MOVE, dest, x);
+		}
+	}
+
+	for(unsigned int t = 0; t < terms.size(); t++) {
+		if(t == base) {
+			continue;
+		}
+		unsigned int shifted = x;
+		if(terms[t].shift > 0) {
+			shifted = fn.newRegister();
+			fn.emit(I_SLL, shifted, x, 0, terms[t].shift);
+		}
+		unsigned int sum = (base < terms.size() || t > 0) ? dest : REG_ZERO;
+		fn.emit(terms[t].negative ? I_SUBU : I_ADDU, dest, sum, shifted);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// DIVISION
+
+// M and s with x / d the high word of M * x shifted right by s, for 2 < d < 2^31
+// not a power of two (Hacker's Delight, 10-1). M may come out above 2^31 and
+// wrap negative, then x has to be added back on to the high word.
+static void magic(unsigned int d, int &multiplier, unsigned int &shift) {
+	const unsigned int TWO31 = 0x80000000;
+	unsigned int anc = TWO31 - 1 - TWO31 % d;							// largest x with x % d == d - 1
+	unsigned int p = 31;
+	unsigned int q1 = TWO31 / anc, r1 = TWO31 - q1 * anc;
+	unsigned int q2 = TWO31 / d, r2 = TWO31 - q2 * d;
+	unsigned int delta;
+	do {
+		p++;
+		q1 = 2 * q1;
+		r1 = 2 * r1;
+		if(r1 >= anc) {
+			q1++;
+			r1 = r1 - anc;
+		}
+		q2 = 2 * q2;
+		r2 = 2 * r2;
+		if(r2 >= d) {
+			q2++;
+			r2 = r2 - d;
+		}
+		delta = d - r2;
+	} while(q1 < delta || (q1 == delta && r1 == 0));
+	multiplier = (int)(q2 + 1);
+	shift = p - 32;
+}
+
+// k with d == 2^k, or -1
+static int log2Exact(unsigned int d) {
+	if(d == 0 || (d & (d - 1)) != 0) {
+		return -1;
+	}
+	int k = 0;
+	while(d > 1) {
+		d = d >> 1;
+		k++;
+	}
+	return k;
+}
+
+// x + 2^k - 1 when x is negative, x otherwise, so shifting right by k rounds towards zero
+static unsigned int biased(MachineFunction &fn, unsigned int x, unsigned int k, unsigned int &bias) {
+	bias = fn.newRegister();
+	if(k > 1) {
+		fn.emit(I_SRA, bias, x, 0, 31);
+		fn.emit(I_SRL, bias, bias, 0, 32 - k);
+	} else {
+		fn.emit(I_SRL, bias, x, 0, 31);
+	}
+	unsigned int sum = fn.newRegister();
+	fn.emit(I_ADDU, sum, x, bias);
+	return sum;
+}
+
+void divideByConstant(MachineFunction &fn, unsigned int dest, unsigned int x, int c, bool remainder) {
+
+	// the remainder takes the sign of x alone, x / -d is -(x / d)
+	unsigned int d = (c < 0) ? -(unsigned int)c : c;
+	bool negate = (c < 0) && !remainder;
+
+	if(d == 1) {
+		if(remainder) {
+			fn.emit(I_MOVE, dest, REG_ZERO);
+		} else if(negate) {
+			fn.emit(I_SUBU, dest, REG_ZERO, x);
+		} else {
+			fn.emit(I_MOVE, dest, x);
+		}
+		return;
+	}
+
+	int k = log2Exact(d);
+	if(k > 0) {
+		unsigned int bias;
+		unsigned int sum = biased(fn, x, k, bias);
+		if(remainder) {
+			// the low bits of the biased x, less the bias again
+			unsigned int low = fn.newRegister();
+			if(fitsUnsigned(d - 1)) {
+				fn.emit(I_ANDI, low, sum, 0, d - 1);
+			} else {
+				fn.emit(I_SLL, low, sum, 0, 32 - k);
+				fn.emit(I_SRL, low, low, 0, 32 - k);
+			}
+			fn.emit(I_SUBU, dest, low, bias);
+		} else if(negate) {
+			fn.emit(I_SRA, sum, sum, 0, k);
+			fn.emit(I_SUBU, dest, REG_ZERO, sum);
+		} else {
+			fn.emit(I_SRA, dest, sum, 0, k);
+		}
+		return;
+	}
+
+	int multiplier;
+	unsigned int shift;
+	magic(d, multiplier, shift);
+
+	unsigned int m = fn.newRegister();
+	unsigned int q = fn.newRegister();
+	fn.emit(I_LI, m, 0, 0, multiplier);
+	fn.emit(I_MULT, 0, x, m);
+	fn.emit(I_MFHI, q);
+	if(multiplier < 0) {
+		fn.emit(I_ADDU, q, q, x);
+	}
+	if(shift > 0) {
+		fn.emit(I_SRA, q, q, 0, shift);
+	}
+	// one more when x is negative, the product rounded down rather than towards zero
+	unsigned int sign = fn.newRegister();
+	fn.emit(I_SRL, sign, x, 0, 31);
+
+	if(remainder) {
+		fn.emit(I_ADDU, q, q, sign);
+		unsigned int product = fn.newRegister();
+		multiplyByConstant(fn, product, q, d);
+		fn.emit(I_SUBU, dest, x, product);
+	} else if(negate) {
+		fn.emit(I_ADDU, q, q, sign);
+		fn.emit(I_SUBU, dest, REG_ZERO, q);
+	} else {
+		fn.emit(I_ADDU, dest, q, sign);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef arith_hpp
+#define arith_hpp
+
+#include "mips.hpp"
+
+// Arithmetic by a constant known at compile time, as cheaper instruction
+// sequences than the general multiply and divide where there are any.
+
+// Emit dest = x * c. Shifts for powers of two and otherwise a sum of
+// shifted copies of x (c written with digits 1, 0 and -1, so runs of ones
+// cost a subtraction rather than an addition each), unless that takes more
+// instructions than mult would take cycles.
+void multiplyByConstant(MachineFunction &fn, unsigned int dest, unsigned int x, int c);
+
+// Emit dest = x / c, or x % c if remainder is set, rounding towards zero as
+// int division does. c must not be zero. Powers of two are a shift with
+// negative x biased up first, anything else a multiply by a fixed point
+// reciprocal of c keeping the high word, so there is no div at all.
+void divideByConstant(MachineFunction &fn, unsigned int dest, unsigned int x, int c, bool remainder);
+
+
+#endif
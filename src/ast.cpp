@@ -1,11 +1,22 @@
 #include "ast.hpp"
 #include "context.hpp"
+#include "compilation.hpp"
+#include "peephole.hpp"
+#include "delayslot.hpp"
+#include "licm.hpp"
+#include "regalloc.hpp"
+#include "frame.hpp"
+#include "arith.hpp"
+
+#include <algorithm>
 
 using namespace std;
 
-int statementNo = 1;
+/////////////////////////////////////////////////////////////////////////////////////////////////// AST NODE
 
-vector<const std::string *> globalVars;
+bool ASTnode::writes(Symbol name) const {
+	return true;
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// PROGRAM
 
@@ -17,11 +28,6 @@ Program::Program(const ASTnode* left_in, const ASTnode* right_in)
 	: left(left_in), right(right_in)
 {}
 
-Program::~Program() {
-	delete left;
-	delete right;
-}
-
 void Program::print() const {
 	if(left != NULL){
 		left->print();
@@ -58,11 +64,6 @@ Scope::Scope(VarSeq* decls_in, StatementSequence* stats_in)
 	: decls(decls_in), stats(stats_in)
 {}
 
-Scope::~Scope() {
-	delete decls;
-	delete stats;
-}
-
 void Scope::print() const {
 	cout << "<Scope>" << endl;
 	if(decls != NULL) {
@@ -74,8 +75,13 @@ void Scope::print() const {
 	cout << "</Scope>" << endl;
 }
 
+bool Scope::writes(Symbol name) const {
+	return ((decls != NULL) && decls->writes(name)) || ((stats != NULL) && stats->writes(name));
+}
+
 void Scope::compile(Context & ctxt, unsigned int destLoc) const {
 	
+	MachineFunction &fn = *ctxt.fn;
 	int declsNo = 0;
 	if(decls != NULL) {
 		// add these variables to stack too if they haven't been added already
@@ -87,286 +93,648 @@ void Scope::compile(Context & ctxt, unsigned int destLoc) const {
 		stats->compile(ctxt, destLoc);
 	}
 	
-	// delete vars initialised here from stack
+	// forget vars declared here
 	for(int i = 0; i < declsNo; i++) {
 		if(ctxt.isDynamic(decls->getDeclaration(i)->id)) {
 			ctxt.deleteDynamic(decls->getDeclaration(i)->id);
-			ctxt.SP = ctxt.SP - 4;
-			ctxt.fsize = ctxt.fsize - 4;
-			cout << "    addiu       $sp, $sp, 8" << endl;
 		}
 	}
 	
 	if((stats == NULL) && (decls == NULL)) {
-		cout << "    nop" << endl;
+		fn.emit(I_NOP);
 	}		
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION - BINARY
+/////////////////////////////////////////////////////////////////////////////////////////////////// OPERATORS
+
+// indexed by BinaryOp
+static const char *binaryOpSpellings[] = {
+	"+", "-", "*", "/", "%",
+	"&", "|", "<<", ">>",
+	"==", "!=", "<", ">", "<=", ">=",
+	"&&", "||"
+};
+
+// indexed by UnaryOp
+static const char *unaryOpSpellings[] = {
+	"++", "--", "!"
+};
 
-BinaryExpression::BinaryExpression(const Expression* left_in, const string* op_in, const Expression* right_in) 
-	: left(left_in), right(right_in), op(op_in)
+const char *spelling(BinaryOp op) {
+	return binaryOpSpellings[op];
+}
+
+const char *spelling(UnaryOp op) {
+	return unaryOpSpellings[op];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION
+
+// a value held across a call has to be in one of $16-$23, so a call counts as needing every register
+static const unsigned int CALL_NEED = 16;
+
+Expression::Expression(unsigned int need_in)
+	: need(need_in)
 {}
 
-BinaryExpression::~BinaryExpression() {
-	delete left;
-	delete op;
-	delete right;
+bool Expression::isConstant(int &value) const {
+	return false;
+}
+
+Symbol Expression::variable() const {
+	return NO_SYMBOL;
+}
+
+bool Expression::hasSideEffects() const {
+	return false;
+}
+
+bool Expression::writes(Symbol name) const {
+	return false;
+}
+
+// operands of these can be swapped
+static bool isCommutative(BinaryOp op) {
+	switch(op) {
+	case OP_ADD: case OP_MUL: case OP_AND: case OP_OR:
+	case OP_EQ: case OP_NE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool isComparison(BinaryOp op) {
+	switch(op) {
+	case OP_EQ: case OP_NE: case OP_LT: case OP_GT: case OP_LE: case OP_GE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// the comparison that holds exactly when op does not
+static BinaryOp inverse(BinaryOp op) {
+	switch(op) {
+	case OP_EQ: return OP_NE;
+	case OP_NE: return OP_EQ;
+	case OP_LT: return OP_GE;
+	case OP_GE: return OP_LT;
+	case OP_GT: return OP_LE;
+	default: return OP_GT;
+	}
+}
+
+// the comparison with its operands swapped
+static BinaryOp mirror(BinaryOp op) {
+	switch(op) {
+	case OP_LT: return OP_GT;
+	case OP_GT: return OP_LT;
+	case OP_LE: return OP_GE;
+	case OP_GE: return OP_LE;
+	default: return op;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION - BINARY
+
+// The instruction computing x op c, or c op x if constantLeft, with c as its
+// immediate (returned in imm). Comparing for (in)equality only gets as far
+// as x ^ c, which is zero when they are equal, and x >= c and c <= x as
+// x < c, which is the opposite. False if there is none.
+static bool immediateForm(BinaryOp op, int c, bool constantLeft, Opcode &form, int &imm) {
+	
+	imm = c;
+	switch(op) {
+	case OP_ADD:
+		form = I_ADDIU;
+		return fitsSigned(c);
+	case OP_SUB:
+		// adding the negated constant
+		form = I_ADDIU;
+		if(constantLeft || !fitsSigned(-(long long)c)) {
+			return false;
+		}
+		imm = -c;
+		return true;
+	case OP_AND:
+		form = I_ANDI;
+		return fitsUnsigned(c);
+	case OP_OR:
+		form = I_ORI;
+		return fitsUnsigned(c);
+	case OP_SHL:
+		form = I_SLL;
+		return !constantLeft && c >= 0 && c < 32;
+	case OP_SHR:
+		form = I_SRA;
+		return !constantLeft && c >= 0 && c < 32;
+	case OP_LT:
+		form = I_SLTI;
+		return !constantLeft && fitsSigned(c);
+	case OP_GT:
+		// c > x is x < c
+		form = I_SLTI;
+		return constantLeft && fitsSigned(c);
+	case OP_LE: case OP_GE:
+		// x <= c and c >= x are x < c + 1
+		form = I_SLTI;
+		if(constantLeft == (op == OP_LE)) {
+			return fitsSigned(c);
+		}
+		imm = c + 1;
+		return fitsSigned(c + 1LL);
+	case OP_EQ: case OP_NE:
+		form = I_XORI;
+		return fitsUnsigned(c);
+	default:
+		return false;
+	}
+}
+
+// the operand that is not a constant folded into an immediate, or NULL if there is none
+static const Expression *immediateOperand(const Expression *left, BinaryOp op, const Expression *right, Opcode &form, int &imm) {
+	int c;
+	if(right->isConstant(c) && immediateForm(op, c, false, form, imm)) {
+		return left;
+	}
+	if(left->isConstant(c) && immediateForm(op, c, true, form, imm)) {
+		return right;
+	}
+	return NULL;
 }
 
+// the register e's value is in: the variable's if that is all e reads, else a new one e is evaluated into
+static unsigned int operandRegister(Context &ctxt, const Expression *e) {
+	Symbol name = e->variable();
+	if(name != NO_SYMBOL) {
+		return ctxt.readVariable(name);
+	}
+	unsigned int reg = ctxt.fn->newRegister();
+	e->compile(ctxt, reg);
+	return reg;
+}
+
+// operandRegister() for both, the one needing more registers first
+static void operandRegisters(Context &ctxt, const Expression *a, const Expression *b, unsigned int &x, unsigned int &y) {
+	if(b->need <= a->need) {
+		x = operandRegister(ctxt, a);
+		y = operandRegister(ctxt, b);
+	} else {
+		y = operandRegister(ctxt, b);
+		x = operandRegister(ctxt, a);
+	}
+}
+
+void Expression::branch(Context & ctxt, bool when, unsigned int label) const {
+	MachineFunction &fn = *ctxt.fn;
+	int c;
+	if(isConstant(c)) {
+		// always or never
+		if((c != 0) == when) {
+			fn.jump(label);
+			fn.emit(I_NOP);
+		}
+		return;
+	}
+	fn.branch(when ? I_BNE : I_BEQ, operandRegister(ctxt, this), REG_ZERO, label);
+	fn.emit(I_NOP);
+}
+
+// One more than the operands if they need the same, otherwise whichever
+// needs more. A constant going in an immediate needs no register at all.
+static unsigned int binaryNeed(const Expression *left, BinaryOp op, const Expression *right) {
+	Opcode form;
+	int imm;
+	const Expression *operand = immediateOperand(left, op, right, form, imm);
+	if(operand != NULL) {
+		return operand->need;
+	}
+	return (left->need == right->need) ? left->need + 1 : max(left->need, right->need);
+}
+
+BinaryExpression::BinaryExpression(const Expression* left_in, BinaryOp op_in, const Expression* right_in) 
+	: Expression(binaryNeed(left_in, op_in, right_in)), left(left_in), right(right_in), op(op_in)
+{}
+
 void BinaryExpression::print() const {
 	if(left != NULL) {
 		left->print();
 	}
-	cout << *op;
+	cout << spelling(op);
 	if(right != NULL) {
 		right->print();
 	}
 
 }
 
+bool BinaryExpression::writes(Symbol name) const {
+	return left->writes(name) || right->writes(name);
+}
+
 void BinaryExpression::compile(Context & ctxt, unsigned int destLoc) const {
+	
+	MachineFunction &fn = *ctxt.fn;
 	// TODO: implement operator hierarchy
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
+	unsigned int temp;
 	
-	// ARITHMETIC
-	if(*op == "+") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    addu        $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+	if(op == OP_LAND || op == OP_LOR) {
+		// 0 unless the operands get as far as setting it to 1
+		unsigned int endLabel = fn.newLabel("$end", ctxt.newLabel());
+		fn.emit(I_MOVE, destLoc, REG_ZERO);
+		branch(ctxt, false, endLabel);
+		fn.emit(I_LI, destLoc, 0, 0, 1);
+		fn.place(endLabel);
+		return;
+	}
 	
-	} else if(*op == "-") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    sub         $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+	int c;
+	const Expression *factor = NULL;
+	if(op == OP_MUL && right->isConstant(c)) {
+		factor = left;
+	} else if(op == OP_MUL && left->isConstant(c)) {
+		factor = right;
+	}
+	if(factor != NULL) {
+		// shifts and adds where they beat mult
+		multiplyByConstant(fn, destLoc, operandRegister(ctxt, factor), c);
+		return;
+	}
 	
-	} else if(*op == "*") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    mult        $" << destLoc << ", $" << free[0] << endl;
-		cout << "    mflo        $" << destLoc << endl;
+	if((op == OP_DIV || op == OP_MOD) && right->isConstant(c) && c != 0) {
+		// a multiply by the reciprocal rather than div
+		divideByConstant(fn, destLoc, operandRegister(ctxt, left), c, op == OP_MOD);
+		return;
+	}
 	
-	} else if(*op == "/") {
+	Opcode form;
+	int imm;
+	const Expression *operand = immediateOperand(left, op, right, form, imm);
+	if(operand != NULL) {
+		// the constant goes in the instruction
+		operand->compile(ctxt, destLoc);
+		if(form != I_XORI || imm != 0) {
+			// x ^ 0 is x itself
+			fn.emit(form, destLoc, destLoc, 0, imm);
+		}
+		switch(op) {
+		case OP_EQ:
+			fn.emit(I_SLTIU, destLoc, destLoc, 0, 1);
+			break;
+		case OP_NE:
+			fn.emit(I_SLTU, destLoc, REG_ZERO, destLoc);
+			break;
+		case OP_LE: case OP_GE:
+			if((op == OP_GE) == (operand == left)) {
+				// x >= c and c <= x came out as x < c
+				fn.emit(I_XORI, destLoc, destLoc, 0, 1);
+			}
+			break;
+		default:
+			break;
+		}
+		return;
+		
+	} else if(right->need <= left->need) {
+		// the operand needing more registers goes first, while nothing else is held
 		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    div         $" << destLoc << ", $" << free[0] << endl;
-		cout << "    mflo        $" << destLoc << endl;
-	
-	} else if(*op == "&") {
+		temp = operandRegister(ctxt, right);
+	} else if(isCommutative(op)) {
+		right->compile(ctxt, destLoc);
+		temp = operandRegister(ctxt, left);
+	} else {
+		temp = operandRegister(ctxt, right);
 		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    and         $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+	}
 	
-	} else if(*op == "|") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    or          $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
-
-	} else if(*op == ">>") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    srlv        $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
-		
-	} else if(*op == "<<") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    sllv        $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+	switch(op) {
 	
-	// COMPARISON	
-	} else if(*op == "==") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    bne         $" << destLoc << ", $" << free[0] << ", $not" << statementNo << endl;
-		cout << "    nop" << endl;
-		// set to 1 if equal (true)
-		cout << "    li          $" << destLoc << ", 1" << endl;
-		cout << "    b           $end" << statementNo << endl;
-		cout << "    nop" << endl;
-		// set to 0 if not equal (false)
-		cout << "$not" << statementNo << ":" << endl;
-		cout << "    move        $" << destLoc << ", $0" << endl;
-		// exit
-		cout << "$end" << statementNo << ":" << endl;
-		statementNo++;
+	// ARITHMETIC
+	case OP_ADD:
+		fn.emit(I_ADDU, destLoc, destLoc, temp);
+		break;
+	
+	case OP_SUB:
+		fn.emit(I_SUBU, destLoc, destLoc, temp);
+		break;
+	
+	case OP_MUL:
+		fn.emit(I_MULT, 0, destLoc, temp);
+		fn.emit(I_MFLO, destLoc);
+		break;
+	
+	case OP_DIV:
+		fn.emit(I_DIV, 0, destLoc, temp);
+		// div does not trap on a zero divisor by itself, 7 is the divide by zero code
+		fn.emit(I_TEQ, 0, temp, REG_ZERO, 7);
+		fn.emit(I_MFLO, destLoc);
+		break;
+	
+	case OP_MOD:
+		fn.emit(I_DIV, 0, destLoc, temp);
+		fn.emit(I_TEQ, 0, temp, REG_ZERO, 7);
+		fn.emit(I_MFHI, destLoc);
+		break;
+	
+	case OP_AND:
+		fn.emit(I_AND, destLoc, destLoc, temp);
+		break;
+	
+	case OP_OR:
+		fn.emit(I_OR, destLoc, destLoc, temp);
+		break;
+
+	case OP_SHR:
+		// int is signed, the sign is shifted in
+		fn.emit(I_SRAV, destLoc, destLoc, temp);
+		break;
 		
-	} else if(*op == "!=") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		cout << "    beq         $" << destLoc << ", $" << free[0] << ", $not" << statementNo << endl;
-		cout << "    nop" << endl;
-		// set to 1 if not equal (true)
-		cout << "    li          $" << destLoc << ", 1" << endl;
-		cout << "    b           $end" << statementNo << endl;
-		cout << "    nop" << endl;
-		// set to 0 if equal (false)
-		cout << "$not" << statementNo << ":" << endl;
-		cout << "    move        $" << destLoc << ", $0" << endl;
-		// exit
-		cout << "$end" << statementNo << ":" << endl;
-		statementNo++;
+	case OP_SHL:
+		fn.emit(I_SLLV, destLoc, destLoc, temp);
+		break;
+	
+	// COMPARISON, all without branches
+	case OP_EQ:
+		// x ^ y is zero only if they are equal, and only zero is below 1 unsigned
+		fn.emit(I_XOR, destLoc, destLoc, temp);
+		fn.emit(I_SLTIU, destLoc, destLoc, 0, 1);
+		break;
 		
-	} else if(*op == ">") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
+	case OP_NE:
+		// anything but zero is above it unsigned
+		fn.emit(I_XOR, destLoc, destLoc, temp);
+		fn.emit(I_SLTU, destLoc, REG_ZERO, destLoc);
+		break;
+		
+	case OP_GT:
 		// set to 1 if greater than (true)
-		cout << "    slt         $" << destLoc << ", $" << free[0] << ", $" << destLoc << endl;
+		fn.emit(I_SLT, destLoc, temp, destLoc);
+		break;
 
-	} else if(*op == "<") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
+	case OP_LT:
 		// set to 1 if less than (true)
-		cout << "    slt         $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+		fn.emit(I_SLT, destLoc, destLoc, temp);
+		break;
 
-	// TODO: ">="
-	} else if(*op == ">=") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
+	case OP_GE:
+		// not less than
+		fn.emit(I_SLT, destLoc, destLoc, temp);
+		fn.emit(I_XORI, destLoc, destLoc, 0, 1);
+		break;
 	
-	// TODO: "<="
-	} else if(*op == "<=") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
+	case OP_LE:
+		// not greater than
+		fn.emit(I_SLT, destLoc, temp, destLoc);
+		fn.emit(I_XORI, destLoc, destLoc, 0, 1);
+		break;
 	
-	} else if(*op == "&&") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		// left and right are 1 if true, return 1 if both are 1 ONLY
-		cout << "    and         $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+	default:
+		break;
 	
-	} else if(*op == "||") {
-		left->compile(ctxt, destLoc);
-		right->compile(ctxt, free[0]);
-		// left and right are 1 if true, return 1 if one is 1
-		cout << "    or          $" << destLoc << ", $" << destLoc << ", $" << free[0] << endl;
+	}
+}
+
+void BinaryExpression::branch(Context & ctxt, bool when, unsigned int label) const {
 	
-	}	else {
-		cout << "    nop" << endl;
-		//cout << "binary operator " << *op << " not implemented" << endl;
-		//exit(1);
+	MachineFunction &fn = *ctxt.fn;
+	
+	if(op == OP_LAND || op == OP_LOR) {
+		// the right operand only runs when the left one leaves the outcome open
+		bool settles = (op == OP_LOR);									// what the left operand being settles the whole
+		if(settles == when) {
+			left->branch(ctxt, when, label);
+			right->branch(ctxt, when, label);
+		} else {
+			unsigned int skipLabel = fn.newLabel("$skip", ctxt.newLabel());
+			left->branch(ctxt, settles, skipLabel);
+			right->branch(ctxt, when, label);
+			fn.place(skipLabel);
+		}
+		return;
+	}
+	
+	if(!isComparison(op)) {
+		Expression::branch(ctxt, when, label);
+		return;
+	}
+	
+	// a test b, with any constant on the right
+	BinaryOp test = when ? op : inverse(op);
+	const Expression *a = left;
+	const Expression *b = right;
+	int k;
+	if(a->isConstant(k) && !b->isConstant(k)) {
+		a = right;
+		b = left;
+		test = mirror(test);
+	}
+	bool constant = b->isConstant(k);
+	
+	if(constant && k == 0) {
+		// the sign of a decides it
+		unsigned int x = operandRegister(ctxt, a);
+		switch(test) {
+		case OP_EQ: fn.branch(I_BEQ, x, REG_ZERO, label); break;
+		case OP_NE: fn.branch(I_BNE, x, REG_ZERO, label); break;
+		case OP_LT: fn.branch(I_BLTZ, x, 0, label); break;
+		case OP_GE: fn.branch(I_BGEZ, x, 0, label); break;
+		case OP_LE: fn.branch(I_BLEZ, x, 0, label); break;
+		default: fn.branch(I_BGTZ, x, 0, label); break;
+		}
+		fn.emit(I_NOP);
+		return;
 	}
-	ctxt.setUnused(free[0]);
 	
+	unsigned int x, y;
+	if(test == OP_EQ || test == OP_NE) {
+		operandRegisters(ctxt, a, b, x, y);
+		fn.branch((test == OP_EQ) ? I_BEQ : I_BNE, x, y, label);
+		fn.emit(I_NOP);
+		return;
+	}
+	
+	// a < b and a >= b take slt a, b; a > b and a <= b take slt b, a
+	unsigned int flag = fn.newRegister();
+	bool less = (test == OP_LT) || (test == OP_GT);						// branch if the slt gives 1
+	if(constant && (test == OP_LT || test == OP_GE) && fitsSigned(k)) {
+		fn.emit(I_SLTI, flag, operandRegister(ctxt, a), 0, k);
+	} else if(constant && (test == OP_GT || test == OP_LE) && fitsSigned(k + 1LL)) {
+		// a > k is not a < k + 1
+		fn.emit(I_SLTI, flag, operandRegister(ctxt, a), 0, k + 1);
+		less = !less;
+	} else {
+		operandRegisters(ctxt, a, b, x, y);
+		if(test == OP_LT || test == OP_GE) {
+			fn.emit(I_SLT, flag, x, y);
+		} else {
+			fn.emit(I_SLT, flag, y, x);
+		}
+	}
+	fn.branch(less ? I_BNE : I_BEQ, flag, REG_ZERO, label);
+	fn.emit(I_NOP);
+}
+
+bool BinaryExpression::hasSideEffects() const {
+	return left->hasSideEffects() || right->hasSideEffects();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION - UNARY
 
-UnaryExpression::UnaryExpression(const std::string* id_in, const string* op_in) 
-	: id(id_in), op(op_in)
+UnaryExpression::UnaryExpression(Symbol id_in, UnaryOp op_in) 
+	: Expression(2), id(id_in), op(op_in)
 {}
 
-UnaryExpression::~UnaryExpression() {
-	delete id;
-	delete op;
+void UnaryExpression::print() const {}
+
+bool UnaryExpression::hasSideEffects() const {
+	// ++ and -- write the variable back
+	return op != OP_NOT;
 }
 
-void UnaryExpression::print() const {}
+bool UnaryExpression::writes(Symbol name) const {
+	return (op != OP_NOT) && (id == name);
+}
 
 void UnaryExpression::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
-	
-	std::string loc = ctxt.findOnStack(id);
-	cout << "    lw          $" << free[0] << ", " << loc << endl;
-	
-	if(*op == "++") {
-		cout << "    addiu       $" << free[0] << ", $" << free[0] << ", 1" << endl;
-	} else if (*op == "--") {
-		cout << "    addiu       $" << free[0] << ", $" << free[0] << ", -1" << endl;
-	} else if (*op == "!") {
-		ctxt.setUsed(free[1]);
-		cout << "    addi        $" << free[1] << ", $0, -1" << endl;
-		cout << "    xor         $" << free[0] << ", $" << free[0] << ", $" << free[1] << endl;
-		ctxt.setUnused(free[1]);
-	} else {
-		cout << "    nop" << endl;
-		//cout << "unary operator " << *op << " not implemented (" << *id << ")" << endl;
-		//exit(1);
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int reg = ctxt.readVariable(id);
+	
+	switch(op) {
+	case OP_INCR:
+		// the value from before
+		fn.emit(I_MOVE, destLoc, reg);
+		fn.emit(I_ADDIU, reg, reg, 0, 1);
+		ctxt.writeVariable(id, reg);
+		break;
+	case OP_DECR:
+		fn.emit(I_MOVE, destLoc, reg);
+		fn.emit(I_ADDIU, reg, reg, 0, -1);
+		ctxt.writeVariable(id, reg);
+		break;
+	case OP_NOT:
+		// 1 if zero, 0 otherwise, the variable itself is left alone
+		fn.emit(I_SLTIU, destLoc, reg, 0, 1);
+		break;
 	}
-	
-	cout << "    sw          $" << free[0] << ", " << loc << endl;
-	ctxt.setUnused(free[0]);
+}
+
+void UnaryExpression::branch(Context & ctxt, bool when, unsigned int label) const {
+	if(op != OP_NOT) {
+		Expression::branch(ctxt, when, label);
+		return;
+	}
+	// !x holds when x is zero
+	MachineFunction &fn = *ctxt.fn;
+	fn.branch(when ? I_BEQ : I_BNE, ctxt.readVariable(id), REG_ZERO, label);
+	fn.emit(I_NOP);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION - IDENTIFIER
 
-IdentifierExpression::IdentifierExpression(const string* name_in)
-	: name(name_in)
+IdentifierExpression::IdentifierExpression(Symbol name_in)
+	: Expression(1), name(name_in)
 {}
 
-IdentifierExpression::~IdentifierExpression() {
-	delete name;
+void IdentifierExpression::print() const {
+	cout << spelling(name);
 }
 
-void IdentifierExpression::print() const {
-	cout << *name;
+Symbol IdentifierExpression::variable() const {
+	return name;
 }
 
 void IdentifierExpression::compile(Context & ctxt, unsigned int destLoc) const {
-	cout << "    lw          $" << destLoc << ", " << ctxt.findOnStack(name) << endl;
+	
+	MachineFunction &fn = *ctxt.fn;
+	fn.emit(I_MOVE, destLoc, ctxt.readVariable(name));
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION - FUNCTION
 
-FunctionExpression::FunctionExpression(const std::string* name_in, ArgSeq* args_in)
-	: name(name_in), args(args_in)
+FunctionExpression::FunctionExpression(Symbol name_in, ArgSeq* args_in)
+	: Expression(CALL_NEED), name(name_in), args(args_in)
 {}
 
-FunctionExpression::~FunctionExpression() {
-	delete name;
+void FunctionExpression::print() const {
+	cout << spelling(name);
 }
 
-void FunctionExpression::print() const {
-	cout << *name;
+bool FunctionExpression::hasSideEffects() const {
+	return true;
+}
+
+bool FunctionExpression::writes(Symbol name) const {
+	// the callee can write globals but not this function's locals, those only through the arguments
+	int argsNo = (args != NULL) ? args->getCount() : 0;
+	for(int i = 0; i < argsNo; i++) {
+		if(args->getDeclaration(i)->writes(name)) {
+			return true;
+		}
+	}
+	return false;
 }
 
 void FunctionExpression::compile(Context & ctxt, unsigned int destLoc) const {
 	
+	MachineFunction &fn = *ctxt.fn;
 	int argsNo = 0;
 	
 	if(args != NULL) {
 		argsNo = args->getCount();
 	}
 	
+	vector<unsigned int> values;
+	for(int i = 0; i < argsNo; i++){
+		unsigned int value = fn.newRegister();
+		args->getDeclaration(i)->compile(ctxt, value);
+		values.push_back(value);
+	}
+	
+	// place arguments in arg registers, only once a call among them can no longer clobber them
 	for(int i = 0; i < argsNo; i++){
-		// place arguments in arg registers
-		args->getDeclaration(i)->compile(ctxt, i+4);
+		fn.emit(I_MOVE, REG_A0+i, values[i]);
 	}
 	
 	// jump and link
-	cout << "    .option     pic0" << endl;
-	cout << "    jal         " << *name << endl;
-	cout << "    nop" << endl;
+	fn.call(name);
+	fn.emit(I_NOP);
 	
 	// obtain returned value
-	cout << "    move        $" << destLoc << ", $2" << endl;
+	fn.emit(I_MOVE, destLoc, REG_V0);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// EXPRESSION - CONSTANT
 
-ConstantExpression::ConstantExpression(const string* value_in)
-	: value(value_in)
+ConstantExpression::ConstantExpression(Symbol value_in)
+	: Expression(1), value(value_in), number(atoi(spelling(value_in).c_str()))
+{}
+
+ConstantExpression::ConstantExpression(Symbol value_in, int number_in)
+	: Expression(1), value(value_in), number(number_in)
 {}
 	
-ConstantExpression::~ConstantExpression() {
-	delete value;
+void ConstantExpression::print() const {
+	cout << spelling(value);
 }
 
-void ConstantExpression::print() const {
-	cout << *value;
+bool ConstantExpression::isConstant(int &value) const {
+	value = number;
+	return true;
 }
 
 void ConstantExpression::compile(Context & ctxt, unsigned int destLoc) const {
-	cout << "    li          $" << destLoc << ", " << *value << endl;
+	
+	MachineFunction &fn = *ctxt.fn;
+	fn.emit(I_LI, destLoc, 0, 0, number);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - SEQUENCE
 
-StatementSequence::StatementSequence() { }
-
-StatementSequence::~StatementSequence() { }
+StatementSequence::StatementSequence(Arena &arena)
+	: list(ArenaAllocator<Statement *>(arena))
+{}
 
 int StatementSequence::getCount() const {
 	return list.size();
@@ -390,6 +758,15 @@ void StatementSequence::print() const {
 	}
 }
 
+bool StatementSequence::writes(Symbol name) const {
+	for(unsigned int i = 0; i < list.size(); i++) {
+		if(list[i]->writes(name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void StatementSequence::compile(Context & ctxt, unsigned int destLoc) const {
 	for(unsigned int i = 0; i < list.size(); i++) {
 		list[i]->compile(ctxt, destLoc);
@@ -402,16 +779,18 @@ ExpressionStatement::ExpressionStatement(const Expression* expr_in)
 	: expression(expr_in)
 {}
 
-ExpressionStatement::~ExpressionStatement() {
-	delete expression;
-}
-
 void ExpressionStatement::print() const {
 	expression->print();
 }
 
+bool ExpressionStatement::writes(Symbol name) const {
+	return expression->writes(name);
+}
+
 void ExpressionStatement::compile(Context & ctxt, unsigned int destLoc) const {
-	expression->compile(ctxt, destLoc);
+	// only the condition of a for is given a virtual register to leave its value in, elsewhere it is dropped
+	unsigned int result = (destLoc >= FIRST_VIRTUAL) ? destLoc : ctxt.fn->newRegister();
+	expression->compile(ctxt, result);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - SCOPE
@@ -420,43 +799,39 @@ ScopeStatement::ScopeStatement(const Scope* scope_in)
 	: scope(scope_in)
 {}
 
-ScopeStatement::~ScopeStatement() {
-	delete scope;
-}
-
 void ScopeStatement::print() const {
 	scope->print();
 }
 
+bool ScopeStatement::writes(Symbol name) const {
+	return scope->writes(name);
+}
+
 void ScopeStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	scope->compile(ctxt, destLoc);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - ASSIGNMENT
 
-AssignmentStatement::AssignmentStatement(const string* id_in, const Expression* rhs_in)
+AssignmentStatement::AssignmentStatement(Symbol id_in, const Expression* rhs_in)
 	: id(id_in), rhs(rhs_in)
 {}
 
-AssignmentStatement::~AssignmentStatement() {
-	delete id;
-	delete rhs;
-}
-
 void AssignmentStatement::print() const {}
 
+bool AssignmentStatement::writes(Symbol name) const {
+	return (id == name) || rhs->writes(name);
+}
+
 void AssignmentStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
-	
-	std::string loc = ctxt.findOnStack(id);
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int temp = fn.newRegister();
 	
-	rhs->compile(ctxt, free[0]);
+	// the right hand side may still read the old value
+	rhs->compile(ctxt, temp);
 	
-	cout << "    sw          $" << free[0] << ", " << loc << endl;
-	
-	ctxt.setUnused(free[0]);
+	ctxt.writeVariable(id, temp);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - IF
@@ -465,33 +840,28 @@ IfStatement::IfStatement(const Expression* cond_in, Statement* true_in)
 	: condition(cond_in), trueclause(true_in)
 {}
 
-IfStatement::~IfStatement() {
-	delete condition;
-	delete trueclause;
-}
-
 void IfStatement::print() const {
 	if(trueclause != NULL) {
 		trueclause->print();
 	}
 }
 
+bool IfStatement::writes(Symbol name) const {
+	return condition->writes(name) || ((trueclause != NULL) && trueclause->writes(name));
+}
+
 void IfStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int label = ctxt.newLabel();
+	unsigned int endLabel = fn.newLabel("$end", label);
+	
 	if(trueclause != NULL) {
 		
-		vector<unsigned int> free = ctxt.freeSavedRegisters();
-		ctxt.setUsed(free[0]);
-
-		// evaluate expression
-		condition->compile(ctxt, free[0]);
-		// free[0] has 1 if true and 0 if false
-		cout << "    beq         $0, $" << free[0] << ", $end" << statementNo << endl;
-		cout << "    nop" << endl;
-		ctxt.setUnused(free[0]);
+		// past the clause if false
+		condition->branch(ctxt, false, endLabel);
 		trueclause->compile(ctxt, destLoc);
-		cout << "$end" << statementNo << ":" << endl;
-		statementNo++;
+		fn.place(endLabel);
 	}
 }
 
@@ -501,12 +871,6 @@ IfElseStatement::IfElseStatement(const Expression* cond_in, Statement* true_in,
 	: condition(cond_in), trueclause(true_in), falseclause(false_in)
 {}
 
-IfElseStatement::~IfElseStatement() {
-	delete condition;
-	delete trueclause;
-	delete falseclause;
-}
-
 void IfElseStatement::print() const {
 	if(trueclause != NULL) {
 		trueclause->print();
@@ -516,31 +880,33 @@ void IfElseStatement::print() const {
 	}
 }
 
+bool IfElseStatement::writes(Symbol name) const {
+	return condition->writes(name) || ((trueclause != NULL) && trueclause->writes(name))
+		|| ((falseclause != NULL) && falseclause->writes(name));
+}
+
 void IfElseStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int label = ctxt.newLabel();
+	unsigned int elseLabel = fn.newLabel("$else", label);
+	unsigned int endLabel = fn.newLabel("$end", label);
 	
-	// evaluate expression
-	condition->compile(ctxt, free[0]);
-	// free[0] has 1 if true and 0 if false
-	cout << "    beq         $0, $" << free[0] << ", $else" << statementNo << endl;
-	cout << "    nop" << endl;
-	ctxt.setUnused(free[0]);
+	// to the else clause if false
+	condition->branch(ctxt, false, elseLabel);
 	
 	if(trueclause != NULL) {
 		trueclause->compile(ctxt, destLoc);
 	}
-	cout << "    b           $end" << statementNo << endl;
+	fn.jump(endLabel);
+	fn.emit(I_NOP);
 	
-	
-	cout << "$else" << statementNo << ":" << endl;
+	fn.place(elseLabel);
 	if(falseclause != NULL) {
 		falseclause->compile(ctxt, destLoc);
 	}
 	
-	cout << "$end" << statementNo << ":" << endl;
-	statementNo++;
+	fn.place(endLabel);
 	
 }
 
@@ -550,38 +916,34 @@ WhileStatement::WhileStatement(const Expression* cond_in, Scope* body_in)
 	: condition(cond_in), body(body_in)
 {}
 
-WhileStatement::~WhileStatement() {
-	delete condition;
-	delete body;
-}
-
 void WhileStatement::print() const {
 	if(body != NULL) {
 		body->print();
 	}
 }
 
+bool WhileStatement::writes(Symbol name) const {
+	return condition->writes(name) || ((body != NULL) && body->writes(name));
+}
+
 void WhileStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int label = ctxt.newLabel();
+	unsigned int topLabel = fn.newLabel("$top", label);
+	unsigned int endLabel = fn.newLabel("$end", label);
 	
-	// evaluate expression
-	cout << "$top" << statementNo << ":" << endl;
-	condition->compile(ctxt, free[0]);
-	// free[0] has 1 if true and 0 if false
-	cout << "    beq         $0, $" << free[0] << ", $end" << statementNo << endl;
-	cout << "    nop" << endl;
+	// tested once on the way in and then at the bottom, one branch per iteration
+	condition->branch(ctxt, false, endLabel);
+	fn.place(topLabel);
 	
 	if(body != NULL) {
 		body->compile(ctxt, destLoc);
 	}
 	
-	cout << "    b           $top" << statementNo << endl;
-	cout << "    nop" << endl;
-	cout << "$end" << statementNo << ":" << endl;
-	statementNo++;
-	ctxt.setUnused(free[0]);
+	// back to the top if true
+	condition->branch(ctxt, true, topLabel);
+	fn.place(endLabel);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - DO WHILE
@@ -589,40 +951,30 @@ void WhileStatement::compile(Context & ctxt, unsigned int destLoc) const {
 DoWhileStatement::DoWhileStatement(Scope* body_in, const Expression* cond_in)
 	: body(body_in), condition(cond_in)
 {}
-	
-DoWhileStatement::~DoWhileStatement() {
-	delete body;
-	delete condition;
-}
-	
+		
 void DoWhileStatement::print() const {
 	if(body != NULL) {
 		body->print();
 	}
 }
 
+bool DoWhileStatement::writes(Symbol name) const {
+	return body->writes(name) || condition->writes(name);
+}
+
 void DoWhileStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int label = ctxt.newLabel();
+	unsigned int topLabel = fn.newLabel("$top", label);
 	
 	// top
-	cout << "$do" << statementNo << ":" << endl;
+	fn.place(topLabel);
 	
 	// body
 	body->compile(ctxt, destLoc);
-	// evaluate expression
-	condition->compile(ctxt, free[0]);
-	// free[0] has 1 if true and 0 if false
-	cout << "    beq         $0, $" << free[0] << ", $end" << statementNo << endl;
-	cout << "    nop" << endl;
-	cout << "    b           $top" << statementNo << endl;
-	cout << "    nop" << endl;
-	
-	// end
-	cout << "$end" << statementNo << ":" << endl;
-	statementNo++;
-	ctxt.setUnused(free[0]);
+	// back to the top if true
+	condition->branch(ctxt, true, topLabel);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - FOR
@@ -631,33 +983,33 @@ ForStatement::ForStatement(const Statement* init_in, const Statement* cond_in, c
 	: init(init_in), condition(cond_in), step(step_in), body(body_in)
 {}
 
-ForStatement::~ForStatement() {
-	delete init;
-	delete condition;
-	delete step;
-	delete body;
-}
-
 void ForStatement::print() const {
 	if(body != NULL) {
 		body->print();
 	}
 }
 
+bool ForStatement::writes(Symbol name) const {
+	return init->writes(name) || condition->writes(name) || step->writes(name) || body->writes(name);
+}
+
 void ForStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	vector<unsigned int> free = ctxt.freeSavedRegisters();
-	ctxt.setUsed(free[0]);
+	if(ctxt.unit->optimize && unroll(ctxt, destLoc)) {
+		return;
+	}
+	
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int label = ctxt.newLabel();
+	unsigned int topLabel = fn.newLabel("$top", label);
+	unsigned int endLabel = fn.newLabel("$end", label);
 	
 	// initialisation
 	init->compile(ctxt, destLoc);
 	
-	// top: check condition
-	cout << "$top" << statementNo << ":" << endl;
-	condition->compile(ctxt, free[0]);
-	// free[0] has 1 if true and 0 if false
-	cout << "    beq         $0, $" << free[0] << ", $end" << statementNo << endl;
-	cout << "    nop" << endl;
+	// guard: skip the loop if false on the way in
+	testCondition(ctxt, false, endLabel);
+	fn.place(topLabel);
 	
 	// body
 	body->compile(ctxt, destLoc);
@@ -665,62 +1017,311 @@ void ForStatement::compile(Context & ctxt, unsigned int destLoc) const {
 	// step
 	step->compile(ctxt, destLoc);
 	
-	// end
-	cout << "    b           $top" << statementNo << endl;
-	cout << "    nop" << endl;
-	cout << "$end" << statementNo << ":" << endl;
-	statementNo++;
-	ctxt.setUnused(free[0]);
+	// bottom: back to the top if true
+	testCondition(ctxt, true, topLabel);
+	fn.place(endLabel);
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - RETURN
-
-ReturnStatement::ReturnStatement(const Expression* in)
-	: thing(in)
-{}
+void ForStatement::testCondition(Context & ctxt, bool when, unsigned int label) const {
+	const ExpressionStatement *test = dynamic_cast<const ExpressionStatement *>(condition);
+	if(test != NULL) {
+		test->expression->branch(ctxt, when, label);
+		return;
+	}
+	MachineFunction &fn = *ctxt.fn;
+	unsigned int temp = fn.newRegister();
+	condition->compile(ctxt, temp);
+	// temp has 1 if true and 0 if false
+	fn.branch(when ? I_BNE : I_BEQ, REG_ZERO, temp, label);
+	fn.emit(I_NOP);
+}
+
+// for(i = start; i < bound; i = i + step) and the like, see ForStatement::unroll
+struct CountedLoop {
+	Symbol counter;
+	int step;															// added each trip, negative counting down
+	bool strict;														// < or >, rather than <= or >=
+	const Expression *bound;											// a constant or a local variable
+	bool startKnown;													// the initialisation sets the counter to a constant
+	int start;
+};
+
+// most instructions the body of an unrolled loop, or a loop written out whole, grows to
+static const unsigned int UNROLLED_SIZE = 64;
+
+// bigger steps are left alone, so the distance a whole pass covers fits an immediate
+static const int STEP_LIMIT = 1024;
+
+// what the step adds to the counter it names, 0 if it is not i++, i--, i = i + c or i = i - c
+static int stepOf(const Statement *step, Symbol &counter) {
+	
+	const ExpressionStatement *expression = dynamic_cast<const ExpressionStatement *>(step);
+	if(expression != NULL) {
+		const UnaryExpression *unary = dynamic_cast<const UnaryExpression *>(expression->expression);
+		if(unary == NULL || unary->op == OP_NOT) {
+			return 0;
+		}
+		counter = unary->id;
+		return (unary->op == OP_INCR) ? 1 : -1;
+	}
+	
+	const AssignmentStatement *assignment = dynamic_cast<const AssignmentStatement *>(step);
+	if(assignment == NULL) {
+		return 0;
+	}
+	const BinaryExpression *sum = dynamic_cast<const BinaryExpression *>(assignment->rhs);
+	int c;
+	if(sum == NULL || sum->left->variable() != assignment->id || !sum->right->isConstant(c)) {
+		return 0;
+	}
+	if(c < -STEP_LIMIT || c > STEP_LIMIT) {
+		return 0;
+	}
+	counter = assignment->id;
+	switch(sum->op) {
+	case OP_ADD: return c;
+	case OP_SUB: return -c;
+	default: return 0;
+	}
+}
 
-ReturnStatement::~ReturnStatement() {
-	delete thing;
+// whether loop counts a local variable by a constant step towards a bound nothing in it changes
+static bool counted(Context &ctxt, const ForStatement &loop, CountedLoop &counted) {
+	
+	counted.counter = NO_SYMBOL;
+	counted.step = stepOf(loop.step, counted.counter);
+	if(counted.step == 0 || !ctxt.isBound(counted.counter) || loop.body->writes(counted.counter)) {
+		return false;
+	}
+	
+	// the counter compared with the bound, turned round so the counter is on the left
+	const ExpressionStatement *test = dynamic_cast<const ExpressionStatement *>(loop.condition);
+	const BinaryExpression *compare = (test != NULL) ? dynamic_cast<const BinaryExpression *>(test->expression) : NULL;
+	if(compare == NULL) {
+		return false;
+	}
+	BinaryOp op = compare->op;
+	if(compare->left->variable() == counted.counter) {
+		counted.bound = compare->right;
+	} else if(compare->right->variable() == counted.counter) {
+		counted.bound = compare->left;
+		op = mirror(op);
+	} else {
+		return false;
+	}
+	
+	// and stepping towards it
+	bool up = (op == OP_LT) || (op == OP_LE);
+	bool down = (op == OP_GT) || (op == OP_GE);
+	if(!(up && counted.step > 0) && !(down && counted.step < 0)) {
+		return false;
+	}
+	counted.strict = (op == OP_LT) || (op == OP_GT);
+	
+	int value;
+	if(!counted.bound->isConstant(value)) {
+		Symbol bound = counted.bound->variable();
+		if(bound == NO_SYMBOL || bound == counted.counter || !ctxt.isBound(bound)) {
+			return false;
+		}
+		if(loop.body->writes(bound) || loop.step->writes(bound)) {
+			return false;
+		}
+	}
+	
+	const AssignmentStatement *init = dynamic_cast<const AssignmentStatement *>(loop.init);
+	counted.startKnown = (init != NULL) && (init->id == counted.counter) && init->rhs->isConstant(counted.start);
+	return true;
 }
 
-void ReturnStatement::print() const {}
+// trips a counted loop makes from its known start to a constant bound
+static long long trips(const CountedLoop &loop, int bound) {
+	long long distance = (long long)bound - loop.start;
+	long long step = loop.step;
+	if(step < 0) {
+		distance = -distance;
+		step = -step;
+	}
+	if(loop.strict) {
+		return (distance > 0) ? (distance + step - 1) / step : 0;
+	}
+	return (distance >= 0) ? distance / step + 1 : 0;
+}
+
+// Instructions one trip of the body and step takes, found by compiling them
+// into a function that is thrown away. nested is set if they hold a loop.
+static unsigned int tripSize(Context &ctxt, const ForStatement &loop, unsigned int destLoc, bool &nested) {
+	
+	MachineFunction scratch(ctxt.fn->name);
+	MachineFunction *fn = ctxt.fn;
+	ctxt.fn = &scratch;
+	ctxt.sizing = true;
+	loop.body->compile(ctxt, destLoc);
+	loop.step->compile(ctxt, destLoc);
+	ctxt.sizing = false;
+	ctxt.fn = fn;
+	
+	// a branch back to a block at or before its own
+	nested = false;
+	vector<int> where = scratch.labelBlocks();
+	for(unsigned int b = 0; b < scratch.blocks.size(); b++) {
+		int next[2];
+		unsigned int n = scratch.successors(b, where, next);
+		for(unsigned int k = 0; k < n; k++) {
+			nested = nested || (next[k] >= 0 && next[k] <= (int)b);
+		}
+	}
+	return scratch.instructionCount();
+}
 
-void ReturnStatement::compile(Context & ctxt, unsigned int destLoc) const {
+bool ForStatement::unroll(Context & ctxt, unsigned int destLoc) const {
 	
-	if (thing != NULL) {
-		thing->compile(ctxt, 2);
-	} else {
-		cout << "    nop" << endl;
+	// only innermost loops, and not while an enclosing one is being sized
+	CountedLoop loop;
+	if(ctxt.unit->unroll < 2 || ctxt.sizing || !counted(ctxt, *this, loop)) {
+		return false;
+	}
+	bool nested;
+	unsigned int size = tripSize(ctxt, *this, destLoc, nested);
+	if(nested) {
+		return false;
 	}
 	
-	// end of function
+	MachineFunction &fn = *ctxt.fn;
+	int bound;
+	bool boundKnown = loop.bound->isConstant(bound);
+	long long count = (loop.startKnown && boundKnown) ? trips(loop, bound) : -1;
+	
+	if(count >= 0 && count * size <= UNROLLED_SIZE) {
+		// written out whole, the condition is never tested
+		init->compile(ctxt, destLoc);
+		for(long long k = 0; k < count; k++) {
+			body->compile(ctxt, destLoc);
+			step->compile(ctxt, destLoc);
+		}
+		return true;
+	}
 	
-	// restore s0-$s7
-	for(int i = 0; i < 8; i++) {
-		cout << "    lw          $s" << i << ", " << 4*(ctxt.argsNo+i) << "($sp)" << endl;
+	unsigned int factor = min(ctxt.unit->unroll, UNROLLED_SIZE / size);
+	if(factor < 2) {
+		return false;
 	}
 	
-	// restore old $fp
-	cout << "    lw          $fp, " << (ctxt.fsize - (4*(ctxt.varNo+ctxt.paramNo+1))) << "($sp)" << endl;
+	unsigned int label = ctxt.newLabel();
+	unsigned int topLabel = fn.newLabel("$top", label);
+	
+	// initialisation
+	init->compile(ctxt, destLoc);
 	
-	// restore return address
-	cout << "    lw          $ra, " << 4*(ctxt.argsNo+8) << "($sp)" << endl;
+	if(count >= 0) {
+		// the odd trips first, then whole passes until the condition fails, there is at least one
+		for(long long k = 0; k < count % factor; k++) {
+			body->compile(ctxt, destLoc);
+			step->compile(ctxt, destLoc);
+		}
+		fn.place(topLabel);
+		for(unsigned int k = 0; k < factor; k++) {
+			body->compile(ctxt, destLoc);
+			step->compile(ctxt, destLoc);
+		}
+		testCondition(ctxt, true, topLabel);
+		return true;
+	}
 	
-	// padding
-	cout << "    nop" << endl;
+	unsigned int restLabel = fn.newLabel("$rest", label);
+	unsigned int againLabel = fn.newLabel("$again", label);
+	unsigned int endLabel = fn.newLabel("$end", label);
+	bool up = (loop.step > 0);
 	
-	// restore stack frame of previous subroutine
-	cout << "    addiu       $sp, $sp, " << ctxt.fsize << endl;
+	// guard: skip the loop if false on the way in
+	testCondition(ctxt, false, endLabel);
 	
-	// return from function
-	cout << "    jr          $ra" << endl;
-	cout << "    nop" << endl;
+	unsigned int counter = ctxt.findRegister(loop.counter);
+	unsigned int edge;
+	if(boundKnown) {
+		edge = fn.newRegister();
+		fn.emit(I_LI, edge, 0, 0, bound);
+	} else {
+		edge = ctxt.findRegister(loop.bound->variable());
+	}
+	
+	// factor trips are left while the counter is more than reach short of the bound
+	int reach = (factor - 1) * abs(loop.step) - (loop.strict ? 0 : 1);
+	
+	// the distance is exact unsigned once the condition holds, so a bound near the end of int is fine
+	unsigned int distance = fn.newRegister();
+	if(up) {
+		fn.emit(I_SUBU, distance, edge, counter);
+	} else {
+		fn.emit(I_SUBU, distance, counter, edge);
+	}
+	unsigned int few = fn.newRegister();
+	fn.emit(I_SLTIU, few, distance, 0, reach + 1);
+	fn.branch(I_BNE, few, REG_ZERO, restLabel);
+	fn.emit(I_NOP);
+	
+	// cannot wrap, it is past the counter
+	unsigned int limit = fn.newRegister();
+	fn.emit(I_ADDIU, limit, edge, 0, up ? -reach : reach);
+	
+	// whole passes of factor trips, then back to the top if there is room for another
+	fn.place(topLabel);
+	for(unsigned int k = 0; k < factor; k++) {
+		body->compile(ctxt, destLoc);
+		step->compile(ctxt, destLoc);
+	}
+	unsigned int more = fn.newRegister();
+	if(up) {
+		fn.emit(I_SLT, more, counter, limit);
+	} else {
+		fn.emit(I_SLT, more, limit, counter);
+	}
+	fn.branch(I_BNE, more, REG_ZERO, topLabel);
+	fn.emit(I_NOP);
+	
+	// the trips left over, fewer than factor, one at a time
+	fn.place(restLabel);
+	testCondition(ctxt, false, endLabel);
+	fn.place(againLabel);
+	body->compile(ctxt, destLoc);
+	step->compile(ctxt, destLoc);
+	testCondition(ctxt, true, againLabel);
+	fn.place(endLabel);
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// STATEMENT - RETURN
+
+ReturnStatement::ReturnStatement(const Expression* in)
+	: thing(in)
+{}
+
+void ReturnStatement::print() const {}
+
+bool ReturnStatement::writes(Symbol name) const {
+	return (thing != NULL) && thing->writes(name);
+}
+
+void ReturnStatement::compile(Context & ctxt, unsigned int destLoc) const {
+	
+	MachineFunction &fn = *ctxt.fn;
+	if (thing != NULL) {
+		unsigned int temp = fn.newRegister();
+		thing->compile(ctxt, temp);
+		fn.emit(I_MOVE, REG_V0, temp);
+	} else {
+		fn.emit(I_NOP);
+	}
+	
+	// return from function, the frame is torn down in front of the jr
+	fn.emit(I_JR, 0, REG_RA);
+	fn.emit(I_NOP);
 
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// DECLARATION - VARIABLE
 
-VarDec::VarDec(const string* _type = NULL, const string* _id = NULL, const Expression* _rhs = NULL)
+VarDec::VarDec(Symbol _type = NO_SYMBOL, Symbol _id = NO_SYMBOL, const Expression* _rhs = NULL)
     : type(_type), id(_id), rhs(_rhs)
 {}
 
@@ -728,72 +1329,62 @@ VarDec::VarDec(const VarDec* p)
 	: type(p->type), id(p->id), rhs(p->rhs)
 {}
 
-VarDec::~VarDec() {
-	delete type;
-	delete id;
-	delete rhs;
+void VarDec::print() const {
+	cout << "<Variable id=\"" << spelling(id) << "\" />" << endl;
 }
 
-void VarDec::print() const {
-	cout << "<Variable id=\"" << *id << "\" />" << endl;
+bool VarDec::writes(Symbol name) const {
+	// a declaration of a name already bound reuses its register
+	return (id == name) || ((rhs != NULL) && rhs->writes(name));
 }
 
 void VarDec::compile(Context & ctxt, unsigned int destLoc) const {
 	
-	std::string loc;
-	
 	if(destLoc == 99) {
 		// is a global variable
-		globalVars.push_back(id);
+		AsmEmitter &out = *ctxt.out;
+		ctxt.unit->globalVars.push_back(id);
 		
-		cout << "    .globl	" << *id << endl;
-		cout << "    .data" << endl;
-		cout << "    .align	2" << endl;
-		cout << "    .type	" <<* id << ", @object" << endl;
-		cout << "    .size	" << *id << ", 4" << endl;
-		cout << *id << ":" << endl;
-		cout << "    .word	10" << endl;				// TODO: calculate
+		out << "    .globl	" << spelling(id) << '\n';
+		out << "    .data\n";
+		out << "    .align	2\n";
+		out << "    .type	" << spelling(id) << ", @object\n";
+		out << "    .size	" << spelling(id) << ", 4\n";
+		out << spelling(id) << ":\n";
+		out << "    .word	10\n";				// TODO: calculate
 		
 		/*
-		if(globalVars.size() == 0) {
-			cout << "    .data" << endl;
+		if(ctxt.unit->globalVars.size() == 0) {
+			out << "    .data\n";
 		}
-		globalVars.push_back(id);
-		cout << "    .comm       " << *id << ", 4, 4" << endl;
+		ctxt.unit->globalVars.push_back(id);
+		out << "    .comm       " << spelling(id) << ", 4, 4\n";
 		*/
 		
 	} else {
 		// is not a global variable
-		if(ctxt.isOnStack(id)) {
-			// variable is already on stack
-			loc = ctxt.findOnStack(id);
-			
-		} else {
-			// variable hasn't been initialised yet, initialise as dynamic variable
-			ctxt.addDynamic(id);
-			ctxt.SP = ctxt.SP + 4;
-			ctxt.fsize = ctxt.fsize + 4;
-			cout << "    addiu       $sp, $sp, -8" << endl;
-			loc = ctxt.findOnStack(id);
+		MachineFunction &fn = *ctxt.fn;
+		
+		if(!ctxt.isBound(id)) {
+			// variable hasn't been declared yet, declare as dynamic variable
+			ctxt.addDynamic(id, fn.newRegister());
 		}
+		unsigned int reg = ctxt.findRegister(id);
 		
 		if(rhs != NULL) {
-			vector<unsigned int> free = ctxt.freeSavedRegisters();
-			ctxt.setUsed(free[0]);
-			
-			rhs->compile(ctxt, free[0]);
-			cout << "    sw          $" << free[0] << ", " << loc << endl;
+			unsigned int temp = fn.newRegister();
 			
-			ctxt.setUnused(free[0]);
+			rhs->compile(ctxt, temp);
+			fn.emit(I_MOVE, reg, temp);
 		}
 	}
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// DECLARATION - SEQUENCE
 
-VarSeq::VarSeq() { }
-
-VarSeq::~VarSeq() { }
+VarSeq::VarSeq(Arena &arena)
+	: list(ArenaAllocator<VarDec *>(arena))
+{}
 
 int VarSeq::getCount() const {
 	return list.size();
@@ -817,6 +1408,15 @@ void VarSeq::print() const {
 	}
 }
 
+bool VarSeq::writes(Symbol name) const {
+	for(unsigned int i = 0; i < list.size(); i++) {
+		if(list[i]->writes(name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void VarSeq::compile(Context & ctxt, unsigned int destLoc) const {
 	for(unsigned int i = 0; i < list.size(); i++) {
 		list[i]->compile(ctxt, i);
@@ -826,10 +1426,10 @@ void VarSeq::compile(Context & ctxt, unsigned int destLoc) const {
 /////////////////////////////////////////////////////////////////////////////////////////////////// DECLARATION - PARAMETERS
 
 ParamDec::ParamDec()
-    : type(NULL), id(NULL)
+    : type(NO_SYMBOL), id(NO_SYMBOL)
 {}
 
-ParamDec::ParamDec(const string* _type, const string* _id)
+ParamDec::ParamDec(Symbol _type, Symbol _id)
     : type(_type), id(_id)
 {}
 
@@ -837,22 +1437,17 @@ ParamDec::ParamDec(const ParamDec* p)
 	: type(p->type), id(p->id)
 {}
 
-ParamDec::~ParamDec() {
-	delete type;
-	delete id;
-}
-
 void ParamDec::print() const {
-	cout << "<Parameter id=\"" << *id << "\" />";
+	cout << "<Parameter id=\"" << spelling(id) << "\" />";
 }
 
 void ParamDec::compile(Context & ctxt, unsigned int destLoc) const {}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// DECLARATION - SEQUENCE
 
-ParamSeq::ParamSeq() { }
-
-ParamSeq::~ParamSeq() { }
+ParamSeq::ParamSeq(Arena &arena)
+	: list(ArenaAllocator<ParamDec *>(arena))
+{}
 
 int ParamSeq::getCount() const {
 	return list.size();
@@ -880,9 +1475,9 @@ void ParamSeq::compile(Context & ctxt, unsigned int destLoc) const {}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// ARGUMENTS
 
-ArgSeq::ArgSeq() {}
-
-ArgSeq::~ArgSeq() {}
+ArgSeq::ArgSeq(Arena &arena)
+	: list(ArenaAllocator<const Expression *>(arena))
+{}
 
 int ArgSeq::getCount() const {
 	return list.size();
@@ -906,25 +1501,18 @@ void ArgSeq::compile(Context & ctxt, unsigned int destLoc) const {}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// DECLARATION - FUNCTION
 
-FunDec::FunDec(const string* _type, const string* _id, ParamSeq* param, Scope* body_in)
+FunDec::FunDec(Symbol _type, Symbol _id, ParamSeq* param, Scope* body_in)
 	: type(_type), id(_id), parameters(param), body(body_in)
 {}
 
-FunDec::~FunDec() {
-	delete type;
-	delete id;
-	delete parameters;
-	delete body;
-}
-
 void FunDec::print() const {
 	
 	if((parameters == NULL) && (body == NULL)) {
-		cout << "<Function id=\"" << *id << "\" />" << endl;
+		cout << "<Function id=\"" << spelling(id) << "\" />" << endl;
 		return;
 	}
 	
-	cout << "<Function id=\"" << *id << "\">" << endl;
+	cout << "<Function id=\"" << spelling(id) << "\">" << endl;
 
 	if (parameters != NULL){
 		parameters->print();
@@ -940,26 +1528,50 @@ void FunDec::print() const {
 }
 
 void FunDec::compile(Context & ctxt, unsigned int destLoc) const {
-
+	
 	if(body == NULL) {
 		// don't do anything for just declarations (not definitions)
 		return;
 	}
 	
-	// need fresh context
-	ctxt = new Context();
+	// only the globals declared above this function are visible in it, copied
+	// since declarations further down are still being added meanwhile
+	vector<Symbol> globals(ctxt.unit->globalVars);
+	Compilation *unit = ctxt.unit;
+	const FunDec *function = this;
+	
+	ctxt.out = &unit->spawn([unit, function, globals](AsmEmitter &out) {
+		// need fresh context
+		MachineFunction fn(function->id);
+		Context fctxt(*unit);
+		fctxt.fn = &fn;
+		function->generate(fctxt, globals);
+		if(unit->failed()) {
+			// the unit is dropped, its code need not be finished
+			return;
+		}
+		// the return generate() ends with is usually behind one in the body
+		fn.dropUnreachable();
+		if(unit->optimize) {
+			hoistInvariants(fn);
+		}
+		allocateRegisters(fn);
+		if(unit->optimize) {
+			peephole(fn);
+		}
+		buildFrame(fn);
+		if(unit->optimize) {
+			fillDelaySlots(fn);
+			// branches the filler moved past their target's first instruction may leave it behind
+			fn.dropUnreachable();
+		}
+		fn.print(out);
+	});
+}
 
-	// .text stuff
-	cout << "    .text       " << endl;
-	cout << "    .align      2" << endl;
-	cout << "    .globl      " << *id << endl;
-	cout << "    .set        nomips16" << endl;
-	cout << "    .set        nomicromips" << endl;
-	cout << "    .ent        " << *id << endl;
-	cout << "    .type       " << *id << ", @function" << endl;
+void FunDec::generate(Context & ctxt, const vector<Symbol> &globals) const {
 	
-	// function label
-	cout << *id << ":"<< endl;
+	MachineFunction &fn = *ctxt.fn;
 	
 	if(parameters != NULL) {
 		ctxt.paramNo = parameters->getCount();
@@ -968,86 +1580,31 @@ void FunDec::compile(Context & ctxt, unsigned int destLoc) const {
 		ctxt.varNo = body->decls->getCount();
 	}
 	
-	ctxt.globlVar = globalVars.size();
-	
-	// DETERMINING FRAME SIZE (in words)
-	ctxt.fsize = 0;
-	ctxt.fsize = ctxt.fsize + 1;				// save old $fp
-	ctxt.fsize = ctxt.fsize + ctxt.varNo; 		// no of variables declared in this subroutine
-	ctxt.fsize = ctxt.fsize + ctxt.paramNo; 	// parameters taken in by subroutine (saved as variables)
-	ctxt.fsize = ctxt.fsize + 8;				// 8 registers to preserve accross subroutine calls
-	ctxt.fsize = ctxt.fsize + 1;				// save old $ra
-	ctxt.fsize = ctxt.fsize + ctxt.argsNo;		// pass up to 4 parameters on subroutine calls from here
-	
-	if(ctxt.fsize % 2 == 0) {
-		// fsize is even, no need for padding
-	} else {
-		// fsize is odd, pad
-		ctxt.fsize = ctxt.fsize + 1;
-	}
-	
-	// from words to bytes
-	ctxt.fsize = ctxt.fsize * 4;
-	ctxt.fsize_org = ctxt.fsize;
-	
-	// more .text stuff
-	cout << "    .frame      $fp, " << ctxt.fsize << ", $31" << endl;
-	cout << "    .mask       0x40000000, -4" << endl;
-	cout << "    .fmask      0x00000000, 0" << endl;
-	cout << "    .set        noreorder" << endl;
-	cout << "    .set        nomacro" << endl;
-	
-	// save current $sp-4 (aka new $fp)
-	cout << "    addiu       $24, $sp, -4" << endl;
-	
-	// generate frame
-	cout << "    addiu       $sp, $sp, -" << ctxt.fsize << endl;
-	
-	// set context SP
-	ctxt.SP = 0;
-	
-	// save old $fp
-	cout << "    sw          $fp, " << (ctxt.fsize - (4*(ctxt.varNo+ctxt.paramNo+1))) << "($sp)" << endl;
-	
-	// set new $sp
-	cout << "    move        $fp, $24" << endl;
+	ctxt.globlVar = globals.size();
 	
-	// save return address
-	cout << "    sw          $ra, " << 4*(ctxt.argsNo+8) << "($sp)" << endl;
+	// the frame (saved registers, $ra, the slots below) is built around
+	// the body once it is known which of them it needs
 	
-	// save $s0-$s7 before modifying
-	for(int i = 0; i < 8; i++) {
-		cout << "    sw          $s" << i << ", " << 4*(ctxt.argsNo+i) << "($sp)" << endl;
-	}
-	
-	// set up $gp for global variables
-	//cout << "    lui         $28,%hi(__gnu_local_gp)" << endl;
-	//cout << "    addiu       $28,$28,%lo(__gnu_local_gp)" << endl;
-	
-	// declare global vars
+	// declare global vars, nothing is copied in: each use goes to memory through %hi/%lo
 	for(int i = 0; i < ctxt.globlVar; i++) {
-		//ctxt.addGlobal(globalVars[i]);
-		ctxt.addVariable(globalVars[i]);
-		cout << "    lui         $16, %hi(" << *globalVars[i] << ")" << endl;
-		cout << "    lw          $16, %lo(" << *globalVars[i] << ")($16)" << endl;
-		cout << "    sw          $16, " << ctxt.findOnStack(globalVars[i]) << endl;
+		ctxt.addGlobal(globals[i]);
 	}
 	
-	// declare parameters as avilable variables & save value on stack
+	// declare parameters as avilable variables & copy them out of the argument registers
 	if(ctxt.paramNo < 4) {
 		for(int i = 0; i < ctxt.paramNo; i++) {
-			ctxt.addVariable(parameters->getDeclaration(i)->id);
-			cout << "    sw          $" << i+4 << ", " << ctxt.findOnStack(parameters->getDeclaration(i)->id) << endl;
+			ctxt.addVariable(parameters->getDeclaration(i)->id, fn.newRegister());
+			fn.emit(I_MOVE, ctxt.findRegister(parameters->getDeclaration(i)->id), REG_A0+i);
 		}
 	} else {
 		// TODO:get arguments from previous stack frame
-		cout << "I haven't implemented more than 4 arguments yet." << endl;
-		exit(1);
+		ctxt.unit->error("I haven't implemented more than 4 arguments yet.");
+		return;
 	}
 	
-	// declare local variables on stack
+	// declare local variables
 	for(int i = 0; i < ctxt.varNo; i++){
-		ctxt.addVariable(body->decls->getDeclaration(i)->id);
+		ctxt.addVariable(body->decls->getDeclaration(i)->id, fn.newRegister());
 	}
 	
 	// assign variables
@@ -1062,7 +1619,7 @@ void FunDec::compile(Context & ctxt, unsigned int destLoc) const {
 	
 	// delete global variables from context
 	for(int i = 0; i < ctxt.globlVar; i++) {
-		ctxt.deleteGlobal(globalVars[i]);
+		ctxt.deleteGlobal(globals[i]);
 	}
 	
 	// delete parameters from context
@@ -1075,32 +1632,8 @@ void FunDec::compile(Context & ctxt, unsigned int destLoc) const {
 		ctxt.deleteVariable(body->decls->getDeclaration(i)->id);
 	}
 	
-	// restore s0-$s7
-	for(int i = 0; i < 8; i++) {
-		cout << "    lw          $s" << i << ", " << 4*(ctxt.argsNo+i) << "($sp)" << endl;
-	}
-	
-	// restore old $fp
-	cout << "    lw          $fp, " << (ctxt.fsize - (4*(ctxt.varNo+ctxt.paramNo+1))) << "($sp)" << endl;
-	
-	// restore return address
-	cout << "    lw          $ra, " << 4*(ctxt.argsNo+8) << "($sp)" << endl;
-	
-	// padding
-	cout << "    nop" << endl;
-	
-	// restore stack frame of previous subroutine
-	cout << "    addiu       $sp, $sp, " << ctxt.fsize << endl;
-	
 	// return from function
-	cout << "    jr          $ra" << endl;
-	cout << "    nop" << endl;
-	
-	// .text stuff
-	cout << "    .set        macro" << endl;
-	cout << "    .set        reorder" << endl;
-	cout << "    .end        " << *id << endl;
-	cout << "    .size       " << *id << ", .-" << *id << endl;
-	cout << endl;
+	fn.emit(I_JR, 0, REG_RA);
+	fn.emit(I_NOP);
 }
 
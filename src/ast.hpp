@@ -9,6 +9,8 @@
 #include <stdlib.h> 
 
 #include "context.hpp"
+#include "symbol.hpp"
+#include "arena.hpp"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////// INITIALISATIONS
 
@@ -43,14 +45,39 @@ class ParamSeq;
 class ArgSeq;
 class FunDec;
 
+/////////////////////////////////////////////////////////////////////////////////////////////////// OPERATORS
+
+// typed opcodes produced by the parser, so codegen can switch on them
+enum BinaryOp {
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+	OP_AND, OP_OR, OP_SHL, OP_SHR,
+	OP_EQ, OP_NE, OP_LT, OP_GT, OP_LE, OP_GE,
+	OP_LAND, OP_LOR
+};
+
+enum UnaryOp {
+	OP_INCR, OP_DECR, OP_NOT
+};
+
+const char *spelling(BinaryOp op);
+const char *spelling(UnaryOp op);
+
 /////////////////////////////////////////////////////////////////////////////////////////////////// AST NODE
 
 class ASTnode {
 public:
 	virtual ~ASTnode() {}
 	
+	// nodes live in their translation unit's Arena and are released with it, never one by one
+	static void *operator new(size_t size, Arena &arena) { return arena.allocate(size); }
+	static void operator delete(void *p, Arena &arena) {}
+	static void operator delete(void *p) {}
+	
 	virtual void print() const = 0;
 	virtual void compile(Context & ctxt, unsigned int destLoc) const = 0;
+	
+	// whether running it may assign the local variable name, true wherever that is not worked out
+	virtual bool writes(Symbol name) const;
 
 };
 
@@ -61,8 +88,6 @@ public:
     const ASTnode* left;
     const ASTnode* right;
 
-    ~Program();
-
     Program(const ASTnode* left_in);
 
     Program(const ASTnode* left_in, const ASTnode* right_in);
@@ -87,10 +112,9 @@ public:
 	
 	Scope(VarSeq* decls_in, StatementSequence* stats_in);
 	
-	~Scope();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -98,10 +122,25 @@ public:
 
 class Expression : public ASTnode {
 public:
+	unsigned int need;													// registers it takes to evaluate without spilling (Sethi-Ullman number)
+	
+	Expression(unsigned int need_in);
 	virtual ~Expression() {}
 	
 	virtual void print() const = 0;
 	virtual void compile(Context & ctxt, unsigned int destLoc) const = 0;
+	
+	// Jump to label if the value is nonzero (when is true) or zero (when is
+	// false), otherwise fall through. Comparisons and && and || branch on
+	// their operands rather than working out 0 or 1 first.
+	virtual void branch(Context & ctxt, bool when, unsigned int label) const;
+	
+	// for simplifying: whether it is a constant (and which), the variable it
+	// just reads if any, and whether evaluating it changes anything
+	virtual bool isConstant(int &value) const;
+	virtual Symbol variable() const;
+	virtual bool hasSideEffects() const;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -109,68 +148,72 @@ class BinaryExpression : public Expression {
 public:
 	const Expression  *left;
 	const Expression  *right;
-	const std::string *op;
+	BinaryOp op;
 	
-	BinaryExpression(const Expression* left_in, const std::string* op_in, const Expression* right_in);
-
-	~BinaryExpression();
+	BinaryExpression(const Expression* left_in, BinaryOp op_in, const Expression* right_in);
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	void branch(Context & ctxt, bool when, unsigned int label) const override;
+	bool hasSideEffects() const override;
+	bool writes(Symbol name) const override;
 
 };
 
 class UnaryExpression : public Expression {
 public:
-	const std::string *id;
-	const std::string *op;
+	Symbol id;
+	UnaryOp op;
 	
-	UnaryExpression(const std::string* id_in, const std::string* op_in);
-
-	~UnaryExpression();
+	UnaryExpression(Symbol id_in, UnaryOp op_in);
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	void branch(Context & ctxt, bool when, unsigned int label) const override;
+	bool hasSideEffects() const override;
+	bool writes(Symbol name) const override;
 
 };
 
 class IdentifierExpression : public Expression {
 public:
-	const std::string *name;
-	
-	IdentifierExpression(const std::string* name_in);
+	Symbol name;
 	
-	~IdentifierExpression();
+	IdentifierExpression(Symbol name_in);
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	Symbol variable() const override;
 
 };
 
 class FunctionExpression : public Expression {
 public:
-	const std::string *name;
+	Symbol name;
 	ArgSeq *args;
 	
-	FunctionExpression(const std::string* name_in, ArgSeq* args_in);
-	
-	~FunctionExpression();
+	FunctionExpression(Symbol name_in, ArgSeq* args_in);
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool hasSideEffects() const override;
+	bool writes(Symbol name) const override;
 
 };
 
 class ConstantExpression : public Expression {
 public:
-	const std::string *value;
+	Symbol value;														// as written
+	int number;															// what it evaluates to
 	
-	ConstantExpression(const std::string* value_in);
+	ConstantExpression(Symbol value_in);
 	
-	~ConstantExpression();
+	// a value worked out by the compiler, spelled in decimal
+	ConstantExpression(Symbol value_in, int number_in);
 
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool isConstant(int &value) const override;
 
 };
 
@@ -188,12 +231,10 @@ public:
 
 class StatementSequence: public Statement {
 private:
-	std::vector <Statement *> list;
+	std::vector <Statement *, ArenaAllocator<Statement *> > list;
 
 public:
-	StatementSequence();
-
-	~StatementSequence();
+	StatementSequence(Arena &arena);
 	
 	int getCount() const;
 	
@@ -203,6 +244,7 @@ public:
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -212,10 +254,9 @@ public:
 	
 	ExpressionStatement(const Expression* expr_in);
 	
-	~ExpressionStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -225,24 +266,22 @@ public:
 	
 	ScopeStatement(const Scope* scope);
 	
-	~ScopeStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
 class AssignmentStatement : public Statement {
 public:
-	const std::string *id;
+	Symbol id;
 	const Expression  *rhs;
 	
-	AssignmentStatement(const std::string* id_in, const Expression* rhs_in);
-	
-	~AssignmentStatement() ;
+	AssignmentStatement(Symbol id_in, const Expression* rhs_in);
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -253,10 +292,9 @@ public:
 	
 	IfStatement(const Expression* cond_in, Statement* true_in);
 	
-	~IfStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -268,10 +306,9 @@ public:
 	
 	IfElseStatement(const Expression* cond_in, Statement* true_in, Statement* false_in);
 	
-	~IfElseStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -282,10 +319,9 @@ public:
 	
 	WhileStatement(const Expression* cond_in, Scope* body_in);
 	
-	~WhileStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -296,10 +332,9 @@ public:
 	
 	DoWhileStatement(Scope* body_in, const Expression* cond_in);
 	
-	~DoWhileStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -312,10 +347,18 @@ public:
 	
 	ForStatement(const Statement* init_in, const Statement* cond_in, const Statement* step_in, Scope* body_in);
 	
-	~ForStatement();
-	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
+	
+	// jump to label if the condition is when, it is tested at both ends of the loop
+	void testCondition(Context & ctxt, bool when, unsigned int label) const;
+	
+	// A counted loop, a local variable stepped by a constant towards a bound
+	// the loop leaves alone, is emitted with its body repeated unit->unroll
+	// times, or written out whole if there are only a few trips known in
+	// advance. False with nothing emitted for any other loop.
+	bool unroll(Context & ctxt, unsigned int destLoc) const;
 
 };
 
@@ -324,11 +367,10 @@ public:
 	const Expression *thing;
 	
 	ReturnStatement(const Expression* in);
-	
-	~ReturnStatement();
 
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
@@ -346,29 +388,26 @@ public:
 
 class VarDec : public Declaration {
 public:
-    const std::string *type;
-    const std::string *id;
+    Symbol type;
+    Symbol id;
 	const Expression *rhs;
 	
-    VarDec(const std::string* _type, const std::string* _id, const Expression* _rhs);
+    VarDec(Symbol _type, Symbol _id, const Expression* _rhs);
 	
     VarDec(const VarDec* p);
-    
-    ~VarDec();
 
     void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
 class VarSeq: public VarDec {
 private:
-	std::vector <VarDec *> list;
+	std::vector <VarDec *, ArenaAllocator<VarDec *> > list;
 
 public:
-	VarSeq();
-
-	~VarSeq();
+	VarSeq(Arena &arena);
 	
 	int getCount() const;
 	
@@ -378,21 +417,20 @@ public:
 	
 	void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+	bool writes(Symbol name) const override;
 
 };
 
 class ParamDec : public Declaration {
 public:
-    const std::string *type;
-    const std::string *id;
+    Symbol type;
+    Symbol id;
     
     ParamDec();
     
-    ParamDec(const std::string* _type, const std::string* _id);
+    ParamDec(Symbol _type, Symbol _id);
 	
     ParamDec(const ParamDec* p);
-    
-    ~ParamDec();
 
     void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
@@ -401,12 +439,10 @@ public:
 
 class ParamSeq: public ParamDec {
 private:
-	std::vector <ParamDec *> list;
+	std::vector <ParamDec *, ArenaAllocator<ParamDec *> > list;
 
 public:
-	ParamSeq();
-
-	~ParamSeq();
+	ParamSeq(Arena &arena);
 	
 	int getCount() const;
 	
@@ -421,12 +457,10 @@ public:
 
 class ArgSeq : public ParamDec {
 private:
-	std::vector <const Expression *> list;
+	std::vector <const Expression *, ArenaAllocator<const Expression *> > list;
 
 public:
-	ArgSeq();
-
-	~ArgSeq();
+	ArgSeq(Arena &arena);
 	
 	int getCount() const;
 	
@@ -441,17 +475,18 @@ public:
 
 class FunDec : public Declaration {
 public:
-    const std::string *type;
-    const std::string *id;
+    Symbol type;
+    Symbol id;
     ParamSeq    *parameters;
     Scope *body;
 
-    FunDec(const std::string* _type, const std::string* _id, ParamSeq* param, Scope* body);
-    
-    ~FunDec();
+    FunDec(Symbol _type, Symbol _id, ParamSeq* param, Scope* body);
 
     void print() const override;
     void compile(Context & ctxt, unsigned int destLoc) const override;
+    
+    // build the function's code into ctxt.fn, globals are the ones visible to it
+    void generate(Context & ctxt, const std::vector<Symbol> &globals) const;
 
 };
 
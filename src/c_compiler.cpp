@@ -1,37 +1,270 @@
 #include "ast.hpp"
 #include "context.hpp"
+#include "compilation.hpp"
+#include "threadpool.hpp"
 
 #include <iostream>
+#include <vector>
+#include <chrono>
+#include <stdlib.h>
 
-using namespace std;
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
-extern const ASTnode *parseAST();
+using namespace std;
 
-int main() {
+// Map a source file so the scanner can read it in place. Flex wants the buffer
+// to end in two NUL bytes, so a zero-filled anonymous region one page larger
+// than needed is reserved first and the file is mapped over the front of it.
+// Pages are private, so the scanner's temporary NUL terminators never reach the file.
+static char *mapSource(const char *path, size_t &mapped, size_t &size) {
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return NULL;
+	}
+	
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	size = st.st_size;
+	
+	size_t page = sysconf(_SC_PAGESIZE);
+	mapped = ((size + 2 + page - 1) / page) * page;
+	
+	void *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	
+	if(size > 0) {
+		if(mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(base, mapped);
+			close(fd);
+			return NULL;
+		}
+	}
+	
+	close(fd);
+	return (char *)base;
+}
 
-    const ASTnode *ast=parseAST();
+// Parse and compile one translation unit, writing the assembly to unit.out.
+// file is mapped and scanned in place, NULL reads stdin. source names the unit in the output.
+// Returns false if the file cannot be read or the unit has errors; those only
+// come back here when the unit's errors are not fatal.
+static bool compileUnit(Compilation &unit, const char *source, const char *file) {
+	
+	unit.source = source;
+	
+	char *base = NULL;
+	size_t mapped = 0;
+	size_t size = 0;
+	
+	if(file != NULL) {
+		base = mapSource(file, mapped, size);
+		if(base == NULL) {
+			return false;
+		}
+	}
+	
+    int status;
+    if(base != NULL) {
+    	status=parseAST(unit, base, size + 2);
+    	// identifiers are interned, so the AST no longer refers to the source
+    	munmap(base, mapped);
+    } else {
+    	status=parseAST(unit, stdin);
+    }
+    if(status != 0) {
+    	return false;
+    }
+    const ASTnode *ast=unit.root;
     
-    Context ctxt = new Context();
+    Context ctxt(unit);
+    AsmEmitter &out = *unit.out;
 
-	cout << endl;
+	out << '\n';
 	/* CHECK THE AST FORMATION
 	cout << "now printing the AST" << endl;
     ast->print();
     cout << endl;
 	*/
     //cout << "now printing the MIPS I code" << endl;
-	cout << "    .file       1 \"test.c\"" << endl;				// TODO
-	cout << "    .section    .mdebug.abi32" << endl;
-	cout << "    .previous   " << endl;
-	cout << "    .nan        legacy" << endl;
-	cout << "    .module     fp=xx" << endl;
-	cout << "    .module     nooddspreg" << endl;
-	cout << "    .abicalls   " << endl;
-	cout << endl;
+	out << "    .file       1 \"" << source << "\"\n";
+	out << "    .section    .mdebug.abi32\n";
+	out << "    .previous   \n";
+	out << "    .nan        legacy\n";
+	out << "    .module     fp=xx\n";
+	out << "    .module     nooddspreg\n";
+	out << "    .abicalls   \n";
+	out << '\n';
     ast->compile(ctxt, 99);
-    cout << endl;
+    // functions generated on the pool are only now in out
+    unit.finish();
+    out << '\n';
+    
+    return !unit.failed();
+}
+
+// a.c -> a.s, next to the input
+static string outputName(const string &file) {
+	if((file.size() > 2) && (file.compare(file.size() - 2, 2, ".c") == 0)) {
+		return file.substr(0, file.size() - 2) + ".s";
+	}
+	return file + ".s";
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// one input of a multi-file run
+struct Job {
+	const char *file;
+	string output;
+	bool ok;
+	double ms;
+	size_t arenaUsed;
+	size_t arenaReserved;
+};
 
-    return 0;
+int main(int argc, char *argv[]) {
+	
+	bool memReport = false;
+	bool optimize = true;
+	unsigned int unroll = 4;
+	unsigned int threads = 0;
+	vector<const char *> files;
+	
+	for(int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if(arg == "--mem-report") {
+			memReport = true;
+		} else if(arg == "-O0") {
+			optimize = false;
+		} else if((arg == "--unroll") && (i + 1 < argc)) {
+			unroll = atoi(argv[++i]);
+		} else if((arg == "-j") && (i + 1 < argc)) {
+			threads = atoi(argv[++i]);
+		} else if(arg.compare(0, 2, "-j") == 0) {
+			threads = atoi(arg.c_str() + 2);
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+	
+	if((threads == 0) && (files.size() <= 1)) {
+		// c_compiler [file]: assembly to stdout, reading the mapped file or stdin
+		const char *file = files.empty() ? NULL : files[0];
+		const char *source = (file != NULL) ? file : "test.c";
+		
+		// owns the AST and all per-unit compiler state
+		Compilation unit;
+		AsmEmitter out(STDOUT_FILENO);
+		unit.out = &out;
+		unit.optimize = optimize;
+		unit.unroll = unroll;
+		if(!compileUnit(unit, source, file)) {
+			cerr << "Could not open " << source << endl;
+			return 1;
+		}
+		out.flush();
+		
+	    if(memReport) {
+	    	struct rusage usage;
+	    	getrusage(RUSAGE_SELF, &usage);
+	    	cerr << "AST arena: " << unit.arena.bytesUsed() << " bytes used, " << unit.arena.bytesReserved() << " bytes reserved in " << unit.arena.blockCount() << " blocks" << endl;
+	    	cerr << "peak resident set: " << usage.ru_maxrss << " KB" << endl;
+	    }
+	    
+	    // tear down the whole AST at once
+	    unit.arena.release();
+	    
+	    return 0;
+	}
+	
+	// c_compiler -j N a.c b.c ...: every unit compiled on the pool into its own .s
+	if(threads == 0) {
+		threads = 1;
+	}
+	
+	vector<Job> jobs(files.size());
+	for(unsigned int i = 0; i < files.size(); i++) {
+		jobs[i].file = files[i];
+		jobs[i].output = outputName(files[i]);
+		jobs[i].ok = false;
+		jobs[i].ms = 0;
+		jobs[i].arenaUsed = 0;
+		jobs[i].arenaReserved = 0;
+	}
+	
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	{
+		ThreadPool pool(threads);
+		for(unsigned int i = 0; i < jobs.size(); i++) {
+			Job *job = &jobs[i];
+			ThreadPool *functions = &pool;
+			pool.submit([job, functions, optimize, unroll]() {
+				chrono::steady_clock::time_point jobStart = chrono::steady_clock::now();
+				int fd = open(job->output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				if(fd >= 0) {
+					Compilation unit;
+					AsmEmitter out(fd);
+					unit.out = &out;
+					unit.optimize = optimize;
+					unit.unroll = unroll;
+					// the unit's functions go on the same pool
+					unit.pool = functions;
+					// an error fails this unit only, the others carry on
+					unit.fatal = false;
+					job->ok = compileUnit(unit, job->file, job->file);
+					job->arenaUsed = unit.arena.bytesUsed();
+					job->arenaReserved = unit.arena.bytesReserved();
+					unit.arena.release();
+					out.flush();
+					close(fd);
+					if(!job->ok) {
+						// leave no half-written assembly behind
+						unlink(job->output.c_str());
+					}
+				}
+				job->ms = millisecondsSince(jobStart);
+			});
+		}
+		pool.wait();
+	}
+	double total = millisecondsSince(start);
+	
+	// report in input order so the log is stable
+	int status = 0;
+	for(unsigned int i = 0; i < jobs.size(); i++) {
+		if(!jobs[i].ok) {
+			cerr << "Could not compile " << jobs[i].file << " to " << jobs[i].output << endl;
+			status = 1;
+			continue;
+		}
+		cerr << jobs[i].file << " -> " << jobs[i].output << ": " << jobs[i].ms << " ms";
+		if(memReport) {
+			cerr << ", AST arena " << jobs[i].arenaUsed << " bytes used, " << jobs[i].arenaReserved << " bytes reserved";
+		}
+		cerr << endl;
+	}
+	cerr << "total: " << jobs.size() << " files in " << total << " ms on " << threads << " threads" << endl;
+	
+	if(memReport) {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		cerr << "peak resident set: " << usage.ru_maxrss << " KB" << endl;
+	}
+	
+	return status;
 }
 
 /* HOW TO TEST 
@@ -39,6 +272,9 @@ int main() {
 couting my shit:
 make clean && clear && make bin/c_compiler && ./bin/c_compiler<test.in
 make clean && clear && make bin/c_compiler && ./bin/c_compiler<test.in > main.s
+make clean && clear && make bin/c_compiler && ./bin/c_compiler test.in > main.s
+make clean && clear && make bin/c_compiler && ./bin/c_compiler --mem-report test.in > main.s
+make clean && clear && make bin/c_compiler && ./bin/c_compiler -j 8 a.c b.c c.c            (writes a.s b.s c.s)
 
 alternatively:
 bash ./run.sh
@@ -1,14 +1,15 @@
 #include "ast.hpp"
+#include "compilation.hpp"
 
 #include <iostream>
 
 using namespace std;
 
-extern const ASTnode *parseAST();
-
 int main() {
 
-    const ASTnode *ast=parseAST();
+    Compilation unit;
+    parseAST(unit, stdin);
+    const ASTnode *ast=unit.root;
 
     cout << endl;
     cout << "<?xml version=\"1.0\"?>" << endl;
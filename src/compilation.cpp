@@ -0,0 +1,63 @@
+#include "compilation.hpp"
+#include "threadpool.hpp"
+
+#include <iostream>
+#include <stdlib.h>
+
+using namespace std;
+
+Compilation::Compilation()
+	: root(NULL), out(NULL), pool(NULL), debug(false), optimize(true), unroll(4), source("test.c"), fatal(true), running(0), errors(false)
+{}
+
+void Compilation::error(const string &message) {
+	
+	if(fatal) {
+		cerr << message << endl;
+		exit(1);
+	}
+	
+	// one write, other units and other functions of this one may be reporting too
+	cerr << (string(source) + ": " + message + "\n");
+	errors.store(true);
+}
+
+bool Compilation::failed() const {
+	return errors.load();
+}
+
+AsmEmitter &Compilation::spawn(const function<void(AsmEmitter &)> &generate) {
+	
+	if(pool == NULL) {
+		generate(*out);
+		return *out;
+	}
+	
+	// the function gets the next buffer, whatever follows it the one after
+	segments.emplace_back();
+	AsmEmitter *text = &segments.back();
+	segments.emplace_back();
+	
+	running.fetch_add(1);
+	pool->submit([this, text, generate]() {
+		generate(*text);
+		running.fetch_sub(1);
+	});
+	
+	return segments.back();
+}
+
+void Compilation::finish() {
+	
+	if(pool == NULL) {
+		return;
+	}
+	
+	// run queued work meanwhile, this may well be a pool thread itself
+	pool->runUntil(running);
+	
+	for(unsigned int i = 0; i < segments.size(); i++) {
+		out->append(segments[i]);
+	}
+	segments.clear();
+}
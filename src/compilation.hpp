@@ -0,0 +1,67 @@
+#ifndef compilation_hpp
+#define compilation_hpp
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <stdio.h>
+
+#include "arena.hpp"
+#include "symbol.hpp"
+#include "emitter.hpp"
+
+class ASTnode;
+class ThreadPool;
+
+// Everything that belongs to one translation unit. Nothing here is shared,
+// so separate units can be parsed and compiled on separate threads.
+class Compilation {
+public:
+	Arena arena;														// owns every AST node
+	const ASTnode *root;
+
+	std::vector<Symbol> globalVars;										// global variables declared so far
+
+	AsmEmitter *out;													// where the assembly goes, set before compiling
+	ThreadPool *pool;													// generate functions here, NULL for in order on this thread
+	bool debug;															// echo tokens while scanning
+	bool optimize;														// run the passes over the machine code
+	unsigned int unroll;												// copies of a counted loop's body per trip, 1 for none
+	const char *source;													// names the unit in error messages
+	bool fatal;															// an error ends the process, as for a file compiled on its own
+
+	Compilation();
+
+	// Report an error in the unit. Unless fatal only the unit fails: compiling
+	// carries on so the caller can drop the unit and go on with the others.
+	void error(const std::string &message);
+	bool failed() const;
+
+	// Generate one function. Without a pool it is written straight to out,
+	// otherwise it runs on the pool into a buffer of its own. Returns the
+	// stream the rest of the unit continues in.
+	AsmEmitter &spawn(const std::function<void(AsmEmitter &)> &generate);
+
+	// wait for spawned functions and append their buffers to out in source order
+	void finish();
+
+private:
+	std::deque<AsmEmitter> segments;							// deque so buffers never move
+	std::atomic<unsigned int> running;
+	std::atomic<bool> errors;											// set from whichever thread failed
+
+};
+
+// Parse a translation unit into unit.root. Both return yyparse's status,
+// 0 unless the source could not be parsed.
+
+// parse a translation unit read from a stream
+int parseAST(Compilation &unit, FILE *in);
+
+// parse a translation unit in place, base must end in two NUL bytes (size includes them)
+int parseAST(Compilation &unit, char *base, size_t size);
+
+
+#endif
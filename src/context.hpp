@@ -7,58 +7,67 @@
 #include <unordered_map>
 #include <exception>
 
+#include "symbol.hpp"
+#include "emitter.hpp"
+#include "mips.hpp"
+
+class Compilation;
 
 class Context {
 public:
-	bool regs[32];
-	unsigned int SP;													// current offset from original $sp initialisation
-	unsigned int fsize_org;
-	unsigned int fsize;
+	Compilation *unit;													// translation unit being compiled
+	AsmEmitter *out;													// where top level declarations go
+	MachineFunction *fn;												// code of the function being compiled
+	
+	unsigned int labelNo;												// next free label number in it
+	bool sizing;														// fn is only compiled into to see how long the code is
 	
 	int paramNo;
 	int varNo;
 	int globlVar;
 	
-	int argsNo;
-	int savedNo;
-	
-	std::unordered_map<std::string, unsigned int> variableBindings;		// in bottom of stack
-	std::unordered_map<std::string, unsigned int> dynamicBindings;		// on top of stack (modify SP accordingly)
+	// nothing takes the address of a variable, so each one lives in a virtual register
+	std::unordered_map<Symbol, unsigned int> variableBindings;			// declared at the top of the function
+	std::unordered_map<Symbol, unsigned int> dynamicBindings;			// declared in an inner scope, dropped at its end
 	
-	std::unordered_map<std::string, unsigned int> globalBindings;		// for global variables
+	std::unordered_map<Symbol, unsigned int> globalBindings;			// for global variables
 
-	Context();
+	Context(Compilation &unit_in);
 	Context(Context* c);
 	~Context();
 	
-	std::vector<unsigned int> freeSavedRegisters();
-	std::vector<unsigned int> freeTmpRegisters();
-	
-	// for Expressions
-	void setUsed(unsigned int i);
-	void setUnused(unsigned int i);
+	unsigned int newLabel();
 	
 	// for Global Variables
-	void addGlobal(const std::string *name);
-	void deleteGlobal(const std::string *name);
-	unsigned int findGlobal(const std::string *name);
-	bool isGlobal(const std::string *name);
+	void addGlobal(Symbol name);
+	void deleteGlobal(Symbol name);
+	unsigned int findGlobal(Symbol name);
+	bool isGlobal(Symbol name);
 	
 	// for Variables
-	void addVariable(const std::string *name);
-	void deleteVariable(const std::string *name);
-	unsigned int findVariable(const std::string *name);
-	bool isVariable(const std::string *name);
+	void addVariable(Symbol name, unsigned int reg);
+	void deleteVariable(Symbol name);
+	unsigned int findVariable(Symbol name);
+	bool isVariable(Symbol name);
 	
 	// for Dynamicly allocated variables
-	void addDynamic(const std::string *name);
-	void deleteDynamic(const std::string *name);
-	unsigned int findDynamic(const std::string *name);
-	bool isDynamic(const std::string *name);
+	void addDynamic(Symbol name, unsigned int reg);
+	void deleteDynamic(Symbol name);
+	unsigned int findDynamic(Symbol name);
+	bool isDynamic(Symbol name);
+	
+	// find the register a variable is in
+	bool isBound(Symbol name);
+	unsigned int findRegister(Symbol name);
+	
+	// Read or write a variable, emitting code into fn. A local is its own
+	// register, a global not hidden by one is loaded or stored where it is
+	// used, so calls and other functions always see its current value.
+	unsigned int readVariable(Symbol name);
+	void writeVariable(Symbol name, unsigned int reg);
 	
-	// find where something is and return it's position on the stack
-	bool isOnStack(const std::string *name);
-	std::string findOnStack(const std::string *name);
+	// %lo(name) off a register just loaded with %hi(name)
+	Address globalAddress(Symbol name);
 
 };
 
@@ -0,0 +1,189 @@
+#include "delayslot.hpp"
+
+using namespace std;
+
+// how far back to look for something to put in a delay slot
+static const int SEARCH_DISTANCE = 16;
+
+static bool isNop(const Instruction &i) {
+	return i.op == I_NOP;
+}
+
+// li of a constant that needs more than 16 bits is assembled as lui and ori,
+// only the first of which would run in a delay slot
+static bool singleInstruction(const Instruction &i) {
+	return (i.op != I_LI) || fitsSigned(i.imm) || fitsUnsigned(i.imm);
+}
+
+// the first instruction of block b is the delay slot of the branch ending the block before
+static bool startsInDelaySlot(const MachineFunction &fn, unsigned int b) {
+	return (b > 0) && !fn.blocks[b - 1].code.empty() && isBranch(fn.blocks[b - 1].code.back().op);
+}
+
+// registers the jump itself reads before its delay slot runs
+static unsigned int jumpReads(const Instruction &jump) {
+	switch(jump.op) {
+	case I_BEQ: case I_BNE:
+		return registerBit(jump.rs) | registerBit(jump.rt);
+	case I_BLTZ: case I_BGEZ: case I_BLEZ: case I_BGTZ:
+		return registerBit(jump.rs);
+	case I_JR:
+		return registerBit(jump.rs);
+	case I_JAL:
+		return registerBit(REG_RA);
+	default:
+		return 0;
+	}
+}
+
+// can b run before a instead of after it
+static bool canSwap(const Instruction &a, const Instruction &b) {
+	if(a.op == I_TEQ || b.op == I_TEQ) {
+		// a trap happens where it is, with everything before it done and nothing after
+		return false;
+	}
+	unsigned int defA = registersDefined(a);
+	unsigned int defB = registersDefined(b);
+	if((defA & (registersUsed(b) | defB)) || (defB & registersUsed(a))) {
+		return false;
+	}
+	bool memoryA = (a.op == I_LW || a.op == I_SW);
+	bool memoryB = (b.op == I_LW || b.op == I_SW);
+	return !(memoryA && memoryB && (a.op == I_SW || b.op == I_SW));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// FROM ABOVE
+
+// Move an instruction from before the jump at k into its delay slot,
+// provided it can be carried past everything in between and the jump.
+static bool fillFromAbove(vector<Instruction> &code, int k, int first) {
+
+	const Instruction &jump = code[k];
+	unsigned int reads = jumpReads(jump);
+	unsigned int writes = (jump.op == I_JAL) ? registerBit(REG_RA) : 0;
+
+	for(int j = k - 1; (j >= first) && (j >= k - SEARCH_DISTANCE); j--) {
+		const Instruction &c = code[j];
+
+		// never take another jump or its delay slot apart
+		if(hasDelaySlot(c.op) || (j > 0 && hasDelaySlot(code[j - 1].op))) {
+			return false;
+		}
+		if(isNop(c) || (!isPure(c.op) && c.op != I_SW) || !singleInstruction(c)) {
+			continue;
+		}
+		if((registersDefined(c) & (reads | writes)) || (registersUsed(c) & writes)) {
+			continue;
+		}
+
+		bool free = true;
+		for(int m = j + 1; free && m < k; m++) {
+			free = canSwap(c, code[m]);
+		}
+		if(free) {
+			Instruction moved = c;
+			code.erase(code.begin() + j);
+			code[k] = moved;
+			return true;
+		}
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// FROM THE TARGET
+
+// Copy the first instruction at the target of the branch ending block b into
+// its delay slot and branch past it instead. When the branch is conditional
+// the copy also runs when it falls through, so it must be harmless there.
+static bool fillFromTarget(MachineFunction &fn, unsigned int b, int t, const vector<unsigned int> &live) {
+
+	vector<Instruction> &code = fn.blocks[b].code;
+	unsigned int k = code.size() - 2;
+	Instruction &jump = code[k];
+
+	if(t < 0 || fn.blocks[t].code.empty()) {
+		return false;
+	}
+
+	Instruction copy = fn.blocks[t].code[0];
+	if(isNop(copy) || hasDelaySlot(copy.op) || !singleInstruction(copy)) {
+		return false;
+	}
+
+	if(jump.op == I_B) {
+		if(!isPure(copy.op) && copy.op != I_SW) {
+			return false;
+		}
+	} else {
+		unsigned int fallthrough = 0;
+		if(b + 1 < fn.blocks.size()) {
+			fallthrough = fn.liveness(fn.blocks[b + 1].code, live[b + 1], NULL);
+		}
+		if(!isPure(copy.op) || (registersDefined(copy) & fallthrough)) {
+			return false;
+		}
+	}
+
+	// split the target after its first instruction so there is somewhere to branch to
+	unsigned int label = fn.newLabel("$fill", fn.labels.size());
+	jump.imm = label;
+	code[k + 1] = copy;
+
+	BasicBlock rest;
+	rest.label = label;
+	rest.code.assign(fn.blocks[t].code.begin() + 1, fn.blocks[t].code.end());
+	fn.blocks[t].code.resize(1);
+	fn.blocks.insert(fn.blocks.begin() + t + 1, rest);
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// PASS
+
+unsigned int fillDelaySlots(MachineFunction &fn) {
+
+	// the target interlocks on loads, so a nop only does something in a delay slot
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		vector<Instruction> &code = fn.blocks[b].code;
+		unsigned int kept = 0;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			bool slot = (i > 0) ? hasDelaySlot(code[i - 1].op) : startsInDelaySlot(fn, b);
+			if(!isNop(code[i]) || slot) {
+				code[kept++] = code[i];
+			}
+		}
+		code.resize(kept);
+	}
+
+	unsigned int filled = 0;
+	vector<unsigned int> live = fn.liveOut();
+
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		int first = startsInDelaySlot(fn, b) ? 1 : 0;
+
+		for(int k = first; k + 1 < (int)fn.blocks[b].code.size(); k++) {
+			vector<Instruction> &code = fn.blocks[b].code;
+			if(!hasDelaySlot(code[k].op) || !isNop(code[k + 1])) {
+				continue;
+			}
+
+			if(fillFromAbove(code, k, first)) {
+				filled++;
+				k--;
+			} else if(k + 2 == (int)code.size() && code[k].op != I_JR && code[k].op != I_JAL) {
+				int t = fn.labelBlocks()[code[k].imm];
+				if(fillFromTarget(fn, b, t, live)) {
+					filled++;
+					live = fn.liveOut();
+					if(t <= (int)b) {
+						// the split moved this block along by one
+						b++;
+					}
+				}
+			}
+			// nothing before the delay slot may move past it
+			first = k + 2;
+		}
+	}
+
+	return filled;
+}
@@ -0,0 +1,13 @@
+#ifndef delayslot_hpp
+#define delayslot_hpp
+
+#include "mips.hpp"
+
+// Put useful work in the delay slots the code generator filled with nop:
+// an independent instruction from earlier in the block, or else a copy of
+// the first instruction at the branch target. Padding nops outside delay
+// slots are dropped. Returns how many slots were filled.
+unsigned int fillDelaySlots(MachineFunction &fn);
+
+
+#endif
@@ -0,0 +1,97 @@
+#include "emitter.hpp"
+
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+using namespace std;
+
+AsmEmitter::AsmEmitter(int fd_in)
+	: fd(fd_in), data(NULL), used(0), capacity(0)
+{
+	// unbound emitters hold a single function, start them small
+	capacity = (fd >= 0) ? BUFFER_SIZE : 4096;
+	data = (char *)malloc(capacity);
+}
+
+AsmEmitter::~AsmEmitter() {
+	flush();
+	free(data);
+}
+
+void AsmEmitter::makeRoom(size_t size) {
+	
+	if(fd >= 0) {
+		flush();
+		if(capacity >= size) {
+			return;
+		}
+	}
+	
+	while(capacity - used < size) {
+		capacity = capacity * 2;
+	}
+	data = (char *)realloc(data, capacity);
+	if(data == NULL) {
+		cerr << "out of memory for assembly output" << endl;
+		exit(1);
+	}
+}
+
+AsmEmitter &AsmEmitter::operator<<(unsigned int value) {
+	// digits come out backwards
+	char digits[10];
+	unsigned int n = 0;
+	do {
+		digits[n] = '0' + (value % 10);
+		value = value / 10;
+		n++;
+	} while(value != 0);
+	
+	reserve(n);
+	while(n > 0) {
+		n--;
+		data[used] = digits[n];
+		used++;
+	}
+	return *this;
+}
+
+AsmEmitter &AsmEmitter::operator<<(int value) {
+	if(value < 0) {
+		*this << '-';
+		// through unsigned so INT_MIN does not overflow
+		return *this << (0u - (unsigned int)value);
+	}
+	return *this << (unsigned int)value;
+}
+
+void AsmEmitter::append(const AsmEmitter &other) {
+	write(other.data, other.used);
+}
+
+void AsmEmitter::flush() {
+	
+	if(fd < 0) {
+		return;
+	}
+	
+	size_t done = 0;
+	while(done < used) {
+		ssize_t n = ::write(fd, data + done, used - done);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			cerr << "could not write assembly output" << endl;
+			exit(1);
+		}
+		done = done + n;
+	}
+	used = 0;
+}
+
+size_t AsmEmitter::size() const {
+	return used;
+}
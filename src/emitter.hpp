@@ -0,0 +1,73 @@
+#ifndef emitter_hpp
+#define emitter_hpp
+
+#include <string>
+#include <cstddef>
+#include <string.h>
+
+// Collects assembly text in one large buffer. An emitter bound to a file
+// descriptor hands the whole buffer to a single write(2) whenever it fills
+// up or is flushed; an unbound one (fd -1) just grows and is later appended
+// to another emitter. Nothing goes through iostream.
+class AsmEmitter {
+private:
+	int fd;
+	char *data;
+	size_t used;
+	size_t capacity;
+
+	void makeRoom(size_t size);
+
+	void reserve(size_t size) {
+		if(capacity - used < size) {
+			makeRoom(size);
+		}
+	}
+
+public:
+	static const size_t BUFFER_SIZE = 1 << 20;
+
+	AsmEmitter(int fd_in = -1);
+	~AsmEmitter();
+
+	AsmEmitter(const AsmEmitter &) = delete;
+	AsmEmitter &operator=(const AsmEmitter &) = delete;
+
+	void write(const char *text, size_t size) {
+		reserve(size);
+		memcpy(data + used, text, size);
+		used = used + size;
+	}
+
+	AsmEmitter &operator<<(const char *text) {
+		write(text, strlen(text));
+		return *this;
+	}
+
+	AsmEmitter &operator<<(const std::string &text) {
+		write(text.data(), text.size());
+		return *this;
+	}
+
+	AsmEmitter &operator<<(char c) {
+		reserve(1);
+		data[used] = c;
+		used++;
+		return *this;
+	}
+
+	AsmEmitter &operator<<(unsigned int value);
+	AsmEmitter &operator<<(int value);
+
+	// copy everything another (unbound) emitter has collected
+	void append(const AsmEmitter &other);
+
+	// write out what is buffered, a no-op for unbound emitters
+	void flush();
+
+	size_t size() const;
+
+};
+
+
+#endif
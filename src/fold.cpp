@@ -0,0 +1,214 @@
+#include "fold.hpp"
+
+#include <limits.h>
+#include <string>
+
+using namespace std;
+
+// left op right as the target works it out, false if C gives it no value
+static bool evaluate(int left, BinaryOp op, int right, int &result) {
+
+	// wrapping arithmetic is done unsigned, where it is defined
+	unsigned int l = left;
+	unsigned int r = right;
+
+	switch(op) {
+	case OP_ADD:
+		result = (int)(l + r);
+		return true;
+	case OP_SUB:
+		result = (int)(l - r);
+		return true;
+	case OP_MUL:
+		result = (int)(l * r);
+		return true;
+	case OP_DIV:
+		if(right == 0 || (left == INT_MIN && right == -1)) {
+			return false;
+		}
+		result = left / right;
+		return true;
+	case OP_MOD:
+		if(right == 0 || (left == INT_MIN && right == -1)) {
+			return false;
+		}
+		result = left % right;
+		return true;
+	case OP_AND:
+		result = (int)(l & r);
+		return true;
+	case OP_OR:
+		result = (int)(l | r);
+		return true;
+	case OP_SHL:
+		if(right < 0 || right > 31) {
+			return false;
+		}
+		result = (int)(l << right);
+		return true;
+	case OP_SHR:
+		if(right < 0 || right > 31) {
+			return false;
+		}
+		result = left >> right;
+		return true;
+	case OP_EQ:
+		result = (left == right);
+		return true;
+	case OP_NE:
+		result = (left != right);
+		return true;
+	case OP_LT:
+		result = (left < right);
+		return true;
+	case OP_GT:
+		result = (left > right);
+		return true;
+	case OP_LE:
+		result = (left <= right);
+		return true;
+	case OP_GE:
+		result = (left >= right);
+		return true;
+	case OP_LAND:
+		result = (left != 0) && (right != 0);
+		return true;
+	case OP_LOR:
+		result = (left != 0) || (right != 0);
+		return true;
+	}
+	return false;
+}
+
+// operators whose operands can be regrouped and swapped
+static bool isAssociative(BinaryOp op) {
+	return (op == OP_ADD) || (op == OP_MUL) || (op == OP_AND) || (op == OP_OR);
+}
+
+static const Expression *constant(Arena &arena, int value) {
+	string text = to_string(value);
+	return new (arena) ConstantExpression(intern(text.c_str(), text.size()), value);
+}
+
+// x op c where c is the constant, or NULL if no identity applies
+static const Expression *identity(Arena &arena, const Expression *x, BinaryOp op, int c) {
+
+	bool droppable = !x->hasSideEffects();
+
+	switch(op) {
+	case OP_ADD: case OP_SUB: case OP_OR: case OP_SHL: case OP_SHR:
+		if(c == 0) {
+			return x;
+		}
+		if(op == OP_OR && c == -1 && droppable) {
+			return constant(arena, -1);
+		}
+		break;
+	case OP_MUL:
+		if(c == 1) {
+			return x;
+		}
+		if(c == 0 && droppable) {
+			return constant(arena, 0);
+		}
+		break;
+	case OP_DIV:
+		if(c == 1) {
+			return x;
+		}
+		break;
+	case OP_MOD:
+		if((c == 1 || c == -1) && droppable) {
+			return constant(arena, 0);
+		}
+		break;
+	case OP_AND:
+		if(c == -1) {
+			return x;
+		}
+		if(c == 0 && droppable) {
+			return constant(arena, 0);
+		}
+		break;
+	default:
+		break;
+	}
+	return NULL;
+}
+
+// x op x, reading the same variable on both sides, or NULL if it depends on x
+static const Expression *sameOperands(Arena &arena, const Expression *x, BinaryOp op) {
+	switch(op) {
+	case OP_AND: case OP_OR:
+		return x;
+	case OP_SUB: case OP_NE: case OP_LT: case OP_GT:
+		return constant(arena, 0);
+	case OP_EQ: case OP_LE: case OP_GE:
+		return constant(arena, 1);
+	default:
+		return NULL;
+	}
+}
+
+const Expression *fold(Arena &arena, const Expression *left, BinaryOp op, const Expression *right) {
+
+	int l, r;
+	bool leftConstant = left->isConstant(l);
+	bool rightConstant = right->isConstant(r);
+
+	if(leftConstant && rightConstant) {
+		int result;
+		if(evaluate(l, op, r, result)) {
+			return constant(arena, result);
+		}
+		return new (arena) BinaryExpression(left, op, right);
+	}
+
+	// the constant goes on the right where the order does not matter
+	if(leftConstant && isAssociative(op)) {
+		const Expression *swap = left;
+		left = right;
+		right = swap;
+		rightConstant = true;
+		r = l;
+		leftConstant = false;
+	}
+
+	if(rightConstant) {
+		// (x op c1) op c2 is x op (c1 op c2), and x - c1 + c2 the same as x + (c2 - c1)
+		const BinaryExpression *inner = dynamic_cast<const BinaryExpression *>(left);
+		int c;
+		if(inner != NULL && inner->right->isConstant(c)) {
+			if(isAssociative(op) && inner->op == op) {
+				int combined;
+				evaluate(c, op, r, combined);
+				return fold(arena, inner->left, op, constant(arena, combined));
+			}
+			if((op == OP_ADD || op == OP_SUB) && (inner->op == OP_ADD || inner->op == OP_SUB)) {
+				unsigned int offset = (inner->op == OP_ADD) ? c : -(unsigned int)c;
+				offset = (op == OP_ADD) ? offset + r : offset - r;
+				return fold(arena, inner->left, OP_ADD, constant(arena, (int)offset));
+			}
+		}
+
+		const Expression *simpler = identity(arena, left, op, r);
+		if(simpler != NULL) {
+			return simpler;
+		}
+	}
+
+	if(leftConstant && l == 0 && (op == OP_SHL || op == OP_SHR) && !right->hasSideEffects()) {
+		// 0 shifted is 0, whatever the amount
+		return left;
+	}
+
+	Symbol name = left->variable();
+	if(name != NO_SYMBOL && name == right->variable()) {
+		const Expression *simpler = sameOperands(arena, left, op);
+		if(simpler != NULL) {
+			return simpler;
+		}
+	}
+
+	return new (arena) BinaryExpression(left, op, right);
+}
@@ -0,0 +1,16 @@
+#ifndef fold_hpp
+#define fold_hpp
+
+#include "ast.hpp"
+
+// Build left op right for the parser, simplified. The operands were built
+// the same way, so whole constant subtrees end up as one constant: they are
+// evaluated as int wrapping around like the target, and a chain such as
+// 2 + (3 + x) has its constants gathered first. Identities (x+0, x*1, x*0,
+// x-x, x&0, x|0 and the like) drop the operation, but only discard an
+// operand evaluating which changes nothing. Division by zero, out of range
+// shifts and anything else without a defined value are left to run time.
+const Expression *fold(Arena &arena, const Expression *left, BinaryOp op, const Expression *right);
+
+
+#endif
@@ -0,0 +1,114 @@
+#include "frame.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+// $16-$23, preserved across calls
+static const unsigned int CALLEE_SAVED = 0x00ff0000;
+
+// bytes the caller leaves at the bottom of its frame for the callee's arguments
+static const unsigned int ARGUMENT_AREA = 16;
+
+struct SavedRegister {
+	unsigned int reg;
+	int offset;															// from $sp after the prologue
+};
+
+static Instruction addImmediate(unsigned int rd, unsigned int rs, int imm) {
+	Instruction i = {I_ADDIU, RELOC_NONE, (Register)rd, (Register)rs, 0, imm, NO_SYMBOL};
+	return i;
+}
+
+static Instruction memory(Opcode op, unsigned int rd, int offset) {
+	Instruction i = {op, RELOC_NONE, (Register)rd, (Register)REG_SP, 0, offset, NO_SYMBOL};
+	return i;
+}
+
+void buildFrame(MachineFunction &fn) {
+
+	// what the body needs
+	unsigned int written = 0;
+	bool calls = false;
+	int slotBytes = 0;
+
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int defined = registersDefined(code[i]);
+			written = written | (defined & CALLEE_SAVED);
+			calls = calls || (code[i].op == I_JAL);
+			if((code[i].op == I_LW || code[i].op == I_SW) && code[i].rs == REG_FP) {
+				// slot n is at -4n($fp)
+				slotBytes = max(slotBytes, 4 - code[i].imm);
+			}
+		}
+	}
+
+	// from the bottom: argument words, $16-$23, $ra, padding, variable slots
+	vector<SavedRegister> saved;
+	int offset = calls ? ARGUMENT_AREA : 0;
+	for(unsigned int r = 16; r < 24; r++) {
+		if(written & registerBit(r)) {
+			SavedRegister s = {r, offset};
+			saved.push_back(s);
+			offset = offset + 4;
+		}
+	}
+	if(calls) {
+		SavedRegister s = {REG_RA, offset};
+		saved.push_back(s);
+		offset = offset + 4;
+	}
+	int size = (offset + slotBytes + 7) & ~7;
+
+	fn.frameSize = size;
+	fn.savedMask = 0;
+	for(unsigned int i = 0; i < saved.size(); i++) {
+		fn.savedMask = fn.savedMask | (1u << saved[i].reg);
+	}
+	fn.savedOffset = saved.empty() ? 0 : saved.back().offset - size;
+	fn.framed = true;
+
+	// $fp stands for the top slot, 4 below the caller's $sp
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			if((code[i].op == I_LW || code[i].op == I_SW) && code[i].rs == REG_FP) {
+				code[i].rs = REG_SP;
+				code[i].imm = code[i].imm + size - 4;
+			}
+		}
+	}
+
+	if(size == 0) {
+		return;
+	}
+
+	// prologue, in a block of its own so a loop at the top of the body cannot branch back into it
+	BasicBlock entry;
+	entry.label = NO_LABEL;
+	entry.code.push_back(addImmediate(REG_SP, REG_SP, -size));
+	for(unsigned int i = 0; i < saved.size(); i++) {
+		entry.code.push_back(memory(I_SW, saved[i].reg, saved[i].offset));
+	}
+
+	// epilogue
+	vector<Instruction> exit;
+	for(unsigned int i = 0; i < saved.size(); i++) {
+		exit.push_back(memory(I_LW, saved[i].reg, saved[i].offset));
+	}
+	exit.push_back(addImmediate(REG_SP, REG_SP, size));
+
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			if(code[i].op == I_JR) {
+				code.insert(code.begin() + i, exit.begin(), exit.end());
+				i = i + exit.size();
+			}
+		}
+	}
+
+	fn.blocks.insert(fn.blocks.begin(), entry);
+}
@@ -0,0 +1,15 @@
+#ifndef frame_hpp
+#define frame_hpp
+
+#include "mips.hpp"
+
+// Wrap the generated body in a prologue and an epilogue in front of every
+// jr. Only what the body needs goes in the frame: the $16-$23 it writes,
+// $ra and the outgoing argument words if it calls anything, the variable
+// slots it addresses. A leaf touching none of those gets no frame at all.
+// The slots are addressed off $fp by the code generator and rewritten to
+// $sp, which stays put in the body, so $fp itself is never set up.
+void buildFrame(MachineFunction &fn);
+
+
+#endif
@@ -0,0 +1,452 @@
+#include "licm.hpp"
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+// the blocks from top to bottom, bottom ending in the branch back to top
+struct Loop {
+	unsigned int top;
+	unsigned int bottom;
+};
+
+// What is known about each virtual register over the whole function.
+struct Uses {
+	vector<unsigned int> occurrences;									// instructions naming it, read or written
+	vector<unsigned int> definitions;
+	vector<bool> local;													// written in one block before any read, read elsewhere only after it
+	vector<bool> copied;												// every read is a move to another register
+};
+
+static bool inner(const Loop &a, const Loop &b) {
+	return (a.bottom - a.top) < (b.bottom - b.top);
+}
+
+// every loop in fn, innermost first, branches back to the same top counted as one loop
+static vector<Loop> findLoops(const MachineFunction &fn) {
+	vector<int> where = fn.labelBlocks();
+	vector<int> bottom(fn.blocks.size(), -1);
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		int next[2];
+		unsigned int n = fn.successors(b, where, next);
+		for(unsigned int k = 0; k < n; k++) {
+			if(next[k] >= 0 && next[k] <= (int)b) {
+				bottom[next[k]] = max(bottom[next[k]], (int)b);
+			}
+		}
+	}
+
+	vector<Loop> loops;
+	for(unsigned int t = 0; t < fn.blocks.size(); t++) {
+		if(bottom[t] >= 0) {
+			Loop loop = {t, (unsigned int)bottom[t]};
+			loops.push_back(loop);
+		}
+	}
+	stable_sort(loops.begin(), loops.end(), inner);
+	return loops;
+}
+
+// the virtual register an instruction writes, numbered from 0, or NO_REGISTER
+static unsigned int virtualDestination(const Instruction &i) {
+	unsigned int d = destinationRegister(i);
+	return (d != NO_REGISTER && d >= FIRST_VIRTUAL) ? d - FIRST_VIRTUAL : NO_REGISTER;
+}
+
+// Expressions are worked out in registers local to a block: written first,
+// maybe several times over as the result builds up, and read after. Those
+// have the same value at each read however the block is reached.
+static Uses analyse(const MachineFunction &fn) {
+
+	unsigned int count = fn.virtualCount;
+	Uses uses;
+	uses.occurrences.assign(count, 0);
+	uses.definitions.assign(count, 0);
+	uses.local.assign(count, false);
+	uses.copied.assign(count, true);
+
+	vector<int> home(count, -1);										// block of the first occurrence
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int sources[2];
+			unsigned int n = sourceRegisters(code[i], sources);
+			for(unsigned int k = 0; k < n; k++) {
+				if(sources[k] < FIRST_VIRTUAL) {
+					continue;
+				}
+				unsigned int v = sources[k] - FIRST_VIRTUAL;
+				uses.occurrences[v]++;
+				uses.copied[v] = uses.copied[v] && (code[i].op == I_MOVE);
+				uses.local[v] = uses.local[v] && (home[v] == (int)b);
+				home[v] = b;
+			}
+			unsigned int d = virtualDestination(code[i]);
+			if(d != NO_REGISTER) {
+				uses.occurrences[d]++;
+				uses.definitions[d]++;
+				uses.local[d] = (home[d] < 0) || (uses.local[d] && (home[d] == (int)b));
+				home[d] = b;
+			}
+		}
+	}
+	return uses;
+}
+
+// Instructions that can run before the loop, and when the loop is not
+// entered at all, without it showing: they only write their destination
+// and read nothing the loop writes outside virtual registers, such as hi
+// and lo. Loads also need memory to stay the same throughout.
+static bool movable(const Instruction &i, bool memoryChanges, unsigned int written) {
+	if(!isPure(i.op) || (registersUsed(i) & written)) {
+		return false;
+	}
+	if(i.op == I_MOVE || (i.op == I_LI && i.imm == 0)) {
+		// nothing gained for the register it would hold across the loop: a copy
+		// can usually share its source's register, and zero ends up as $0
+		return false;
+	}
+	return (i.op != I_LW) || !memoryChanges;
+}
+
+// What the loop knows while it goes through one of its blocks.
+struct LoopState {
+	bool memoryChanges;													// the loop has stores or calls
+	unsigned int written;												// registers, and hi and lo, the loop writes
+	vector<unsigned int> occurrences;									// in the loop
+	vector<unsigned int> definitions;									// in the loop, less those taken out
+	vector<unsigned int> here;											// definitions in the block
+	vector<bool> current;												// the value so far in the block is invariant
+	vector<bool> kept;													// some definition has to stay in the loop
+};
+
+// Give the first definitions of d in code, up to but not including the
+// one at last, a new register of their own, along with the reads of them.
+static void split(MachineFunction &fn, vector<Instruction> &code, unsigned int last, unsigned int d, Uses &uses, LoopState &state) {
+
+	unsigned int from = FIRST_VIRTUAL + d;
+	unsigned int to = fn.newRegister();
+	unsigned int occurrences = 0;
+	unsigned int definitions = 0;
+	for(unsigned int i = 0; i <= last; i++) {
+		Instruction &c = code[i];
+		unsigned int sources[2];
+		unsigned int n = sourceRegisters(c, sources);
+		for(unsigned int k = 0; k < n; k++) {
+			occurrences = occurrences + ((sources[k] == from) ? 1 : 0);
+		}
+		bool writes = (destinationRegister(c) == from);
+		if(i < last && writes) {
+			occurrences++;
+			definitions++;
+		}
+
+		// last keeps writing d, from what the others leave in the new register
+		if(c.rd == from && (i < last || !writes)) {
+			c.rd = to;
+		}
+		if(c.rs == from) {
+			c.rs = to;
+		}
+		if(c.rt == from) {
+			c.rt = to;
+		}
+	}
+
+	uses.occurrences.push_back(occurrences);
+	uses.definitions.push_back(definitions);
+	uses.local.push_back(true);
+	uses.copied.push_back(false);
+	uses.occurrences[d] = uses.occurrences[d] - occurrences;
+	uses.definitions[d] = uses.definitions[d] - definitions;
+
+	state.occurrences.push_back(occurrences);
+	state.definitions.push_back(definitions);
+	state.here.push_back(definitions);
+	state.current.push_back(true);
+	state.kept.push_back(false);
+	state.occurrences[d] = state.occurrences[d] - occurrences;
+	state.definitions[d] = state.definitions[d] - definitions;
+	state.here[d] = state.here[d] - definitions;
+}
+
+// Mark the instructions of code that give the same value on every trip,
+// going forward so each can build on the ones before. A register has all
+// its definitions taken out of the loop or none; when a value is built up
+// in one register and only the first steps are invariant, those get a new
+// register for themselves.
+static void markInvariants(MachineFunction &fn, vector<Instruction> &code, Uses &uses, LoopState &state, vector<bool> &marked) {
+
+	for(unsigned int i = 0; i < code.size(); i++) {
+		unsigned int d = virtualDestination(code[i]);
+		if(d != NO_REGISTER) {
+			state.current[d] = false;
+		}
+	}
+
+	for(unsigned int i = 0; i < code.size(); i++) {
+		const Instruction &c = code[i];
+		unsigned int d = virtualDestination(c);
+		bool slot = (i > 0) && hasDelaySlot(code[i - 1].op);
+
+		// a register only the loop uses, written in this block and nowhere else...
+		bool invariant = !slot && (d != NO_REGISTER) && movable(c, state.memoryChanges, state.written);
+		invariant = invariant && uses.local[d] && !uses.copied[d] && !state.kept[d];
+		invariant = invariant && (state.occurrences[d] == uses.occurrences[d]) && (state.here[d] == uses.definitions[d]);
+
+		// ...from $0, registers the loop does not write and values in the block already marked
+		unsigned int sources[2];
+		unsigned int n = sourceRegisters(c, sources);
+		for(unsigned int k = 0; invariant && k < n; k++) {
+			unsigned int r = sources[k];
+			if(r != REG_ZERO) {
+				invariant = (r >= FIRST_VIRTUAL) && ((state.definitions[r - FIRST_VIRTUAL] == 0) || state.current[r - FIRST_VIRTUAL]);
+			}
+		}
+
+		marked[i] = invariant;
+		if(d == NO_REGISTER || invariant) {
+			if(d != NO_REGISTER) {
+				state.current[d] = true;
+			}
+			continue;
+		}
+		if(state.current[d]) {
+			split(fn, code, i, d, uses, state);
+		}
+		state.current[d] = false;
+		state.kept[d] = true;
+	}
+}
+
+// Take the invariant instructions out of the loop and return them in order.
+static vector<Instruction> hoist(MachineFunction &fn, const Loop &loop, Uses &uses) {
+
+	unsigned int count = fn.virtualCount;
+	LoopState state;
+	state.memoryChanges = false;
+	state.written = 0;
+	state.occurrences.assign(count, 0);
+	state.definitions.assign(count, 0);
+	state.here.assign(count, 0);
+	state.current.assign(count, false);
+	state.kept.assign(count, false);
+
+	for(unsigned int b = loop.top; b <= loop.bottom; b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int sources[2];
+			unsigned int n = sourceRegisters(code[i], sources);
+			for(unsigned int k = 0; k < n; k++) {
+				if(sources[k] >= FIRST_VIRTUAL) {
+					state.occurrences[sources[k] - FIRST_VIRTUAL]++;
+				}
+			}
+			unsigned int d = virtualDestination(code[i]);
+			if(d != NO_REGISTER) {
+				state.occurrences[d]++;
+				state.definitions[d]++;
+			}
+			state.memoryChanges = state.memoryChanges || (code[i].op == I_SW) || (code[i].op == I_JAL);
+			state.written = state.written | registersDefined(code[i]);
+		}
+	}
+
+	vector<Instruction> hoisted;
+	for(unsigned int b = loop.top; b <= loop.bottom; b++) {
+		vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int d = virtualDestination(code[i]);
+			if(d != NO_REGISTER) {
+				state.here[d]++;
+			}
+		}
+
+		vector<bool> marked(code.size(), false);
+		markInvariants(fn, code, uses, state, marked);
+
+		unsigned int kept = 0;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int d = virtualDestination(code[i]);
+			if(d != NO_REGISTER) {
+				state.here[d] = 0;
+			}
+			if(marked[i]) {
+				state.definitions[d]--;
+				hoisted.push_back(code[i]);
+			} else {
+				code[kept++] = code[i];
+			}
+		}
+		code.resize(kept);
+	}
+	return hoisted;
+}
+
+// rename the registers from in renamed wherever code names them
+static void rename(Instruction &c, const map<unsigned int, unsigned int> &renamed) {
+	map<unsigned int, unsigned int>::const_iterator to;
+	if((to = renamed.find(c.rd)) != renamed.end()) {
+		c.rd = (Register)to->second;
+	}
+	if((to = renamed.find(c.rs)) != renamed.end()) {
+		c.rs = (Register)to->second;
+	}
+	if((to = renamed.find(c.rt)) != renamed.end()) {
+		c.rt = (Register)to->second;
+	}
+}
+
+// Loops written out several times over, unrolled ones, take the same
+// invariants out once per copy. Where two registers end up holding the same
+// value the loop reads the first, and whatever then goes unread is dropped.
+static void share(MachineFunction &fn, vector<Instruction> &hoisted, const Loop &loop, Uses &uses) {
+
+	// value numbers: the same operation on the same values gives the same number
+	map<vector<int>, unsigned int> computed;
+	map<unsigned int, unsigned int> value;
+	unsigned int numbers = 0;
+	vector<unsigned int> written;										// in the order first written
+	for(unsigned int i = 0; i < hoisted.size(); i++) {
+		const Instruction &c = hoisted[i];
+		vector<int> key;
+		key.push_back(c.op);
+		key.push_back(c.reloc);
+		key.push_back(c.imm);
+		key.push_back(c.symbol);
+		unsigned int sources[2];
+		unsigned int n = sourceRegisters(c, sources);
+		for(unsigned int k = 0; k < n; k++) {
+			if(value.find(sources[k]) == value.end()) {
+				// whatever it held on the way in
+				value[sources[k]] = numbers++;
+			}
+			key.push_back(value[sources[k]]);
+		}
+		if(computed.find(key) == computed.end()) {
+			computed[key] = numbers++;
+		}
+		unsigned int d = destinationRegister(c);
+		if(find(written.begin(), written.end(), d) == written.end()) {
+			written.push_back(d);
+		}
+		value[d] = computed[key];
+	}
+
+	// the first register left with each value stands in for the others in the loop
+	map<unsigned int, unsigned int> holder;
+	map<unsigned int, unsigned int> renamed;
+	for(unsigned int k = 0; k < written.size(); k++) {
+		unsigned int d = written[k];
+		if(holder.find(value[d]) == holder.end()) {
+			holder[value[d]] = d;
+		} else {
+			renamed[d] = holder[value[d]];
+		}
+	}
+	if(renamed.empty()) {
+		return;
+	}
+
+	// none of them is written in the loop any more, so this only changes reads
+	vector<bool> read(fn.virtualCount, false);
+	for(unsigned int b = loop.top; b <= loop.bottom; b++) {
+		vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int sources[2];
+			unsigned int n = sourceRegisters(code[i], sources);
+			for(unsigned int k = 0; k < n; k++) {
+				map<unsigned int, unsigned int>::iterator r = renamed.find(sources[k]);
+				if(r != renamed.end()) {
+					unsigned int from = r->first - FIRST_VIRTUAL;
+					unsigned int to = r->second - FIRST_VIRTUAL;
+					uses.occurrences[from]--;
+					uses.occurrences[to]++;
+					uses.copied[to] = uses.copied[to] && (code[i].op == I_MOVE);
+					sources[k] = r->second;
+				}
+				if(sources[k] >= FIRST_VIRTUAL) {
+					read[sources[k] - FIRST_VIRTUAL] = true;
+				}
+			}
+			rename(code[i], renamed);
+		}
+	}
+
+	// keep what the loop reads and what that is worked out from, going backwards
+	vector<bool> needed(hoisted.size(), false);
+	for(unsigned int i = hoisted.size(); i-- > 0; ) {
+		unsigned int d = destinationRegister(hoisted[i]) - FIRST_VIRTUAL;
+		if(!read[d]) {
+			continue;
+		}
+		needed[i] = true;
+		read[d] = false;
+		unsigned int sources[2];
+		unsigned int n = sourceRegisters(hoisted[i], sources);
+		for(unsigned int k = 0; k < n; k++) {
+			if(sources[k] >= FIRST_VIRTUAL) {
+				read[sources[k] - FIRST_VIRTUAL] = true;
+			}
+		}
+	}
+
+	unsigned int kept = 0;
+	for(unsigned int i = 0; i < hoisted.size(); i++) {
+		if(needed[i]) {
+			hoisted[kept++] = hoisted[i];
+			continue;
+		}
+		unsigned int sources[2];
+		unsigned int n = sourceRegisters(hoisted[i], sources);
+		for(unsigned int k = 0; k < n; k++) {
+			if(sources[k] >= FIRST_VIRTUAL) {
+				uses.occurrences[sources[k] - FIRST_VIRTUAL]--;
+			}
+		}
+		unsigned int d = destinationRegister(hoisted[i]) - FIRST_VIRTUAL;
+		uses.occurrences[d]--;
+		uses.definitions[d]--;
+	}
+	hoisted.resize(kept);
+}
+
+unsigned int hoistInvariants(MachineFunction &fn) {
+
+	vector<Loop> loops = findLoops(fn);
+	if(loops.empty()) {
+		return 0;
+	}
+	Uses uses = analyse(fn);
+
+	unsigned int moved = 0;
+	for(unsigned int l = 0; l < loops.size(); l++) {
+		vector<Instruction> hoisted = hoist(fn, loops[l], uses);
+		if(hoisted.empty()) {
+			continue;
+		}
+		share(fn, hoisted, loops[l], uses);
+		moved = moved + hoisted.size();
+
+		// Only the loop reads what was taken out, after this block which it
+		// all went in, so each register is still written in one block before
+		// it is read, as far as loops further out are concerned.
+		unsigned int top = loops[l].top;
+		BasicBlock preheader;
+		preheader.label = NO_LABEL;
+		preheader.code = hoisted;
+		fn.blocks.insert(fn.blocks.begin() + top, preheader);
+
+		// loops further on move along, and the ones around this one grow
+		for(unsigned int m = l + 1; m < loops.size(); m++) {
+			if(loops[m].top >= top) {
+				loops[m].top++;
+			}
+			if(loops[m].bottom >= top) {
+				loops[m].bottom++;
+			}
+		}
+	}
+	return moved;
+}
@@ -0,0 +1,17 @@
+#ifndef licm_hpp
+#define licm_hpp
+
+#include "mips.hpp"
+
+// Move computations that give the same value on every trip round a loop
+// into a new block just before the loop, innermost loops first so a value
+// can move out through several levels. Only instructions that cannot trap
+// or change anything but their own virtual register qualify, and loads only
+// from loops without stores or calls. The same value taken out twice, as
+// from the copies of an unrolled body, is kept in one register. Runs on
+// virtual registers, before allocateRegisters(). Returns how many
+// instructions were moved.
+unsigned int hoistInvariants(MachineFunction &fn);
+
+
+#endif
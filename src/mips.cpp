@@ -0,0 +1,554 @@
+#include "mips.hpp"
+
+#include <stdio.h>
+
+using namespace std;
+
+// indexed by Opcode, padded so operands start in column 16
+static const char *mnemonics[] = {
+	"    addu        ", "    sub         ", "    subu        ", "    and         ",
+	"    or          ", "    xor         ", "    nor         ", "    slt         ",
+	"    sltu        ", "    sllv        ", "    srlv        ", "    srav        ",
+	"    addi        ", "    addiu       ", "    andi        ", "    ori         ",
+	"    xori        ", "    slti        ", "    sltiu       ", "    sll         ",
+	"    srl         ", "    sra         ",
+	"    mult        ", "    div         ", "    divu        ", "    mfhi        ",
+	"    mflo        ",
+	"    li          ", "    lui         ", "    move        ",
+	"    lw          ", "    sw          ",
+	"    b           ", "    beq         ", "    bne         ",
+	"    bltz        ", "    bgez        ", "    blez        ", "    bgtz        ",
+	"    jal         ", "    jr          ",
+	"    teq         ",
+	"    nop"
+};
+
+// indexed by Reloc
+static const char *relocations[] = {
+	"", "%hi(", "%lo(", "%got("
+};
+
+bool isBranch(Opcode op) {
+	switch(op) {
+	case I_B: case I_BEQ: case I_BNE: case I_BLTZ: case I_BGEZ: case I_BLEZ: case I_BGTZ: case I_JR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool hasDelaySlot(Opcode op) {
+	return isBranch(op) || (op == I_JAL);
+}
+
+bool isPure(Opcode op) {
+	switch(op) {
+	case I_ADDU: case I_SUBU: case I_AND: case I_OR: case I_XOR: case I_NOR:
+	case I_SLT: case I_SLTU: case I_SLLV: case I_SRLV: case I_SRAV:
+	case I_ADDIU: case I_ANDI: case I_ORI: case I_XORI: case I_SLTI: case I_SLTIU:
+	case I_SLL: case I_SRL: case I_SRA:
+	case I_MFHI: case I_MFLO: case I_LI: case I_LUI: case I_MOVE: case I_LW:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// registers a call may leave changed: $1-$15, $24, $25 and $ra
+static const unsigned int CALL_CLOBBERED = 0x0000fffe | 0x03000000 | (1u << REG_RA);
+
+// what the caller of a returning function relies on: the result and the frame
+static const unsigned int RETURN_LIVE = 0x0000000c | (1u << REG_GP) | (1u << REG_SP) | (1u << REG_FP);
+
+// $16-$23, the caller also relies on these once the function saves and restores them
+static const unsigned int CALLEE_SAVED = 0x00ff0000;
+
+unsigned int sourceRegisters(const Instruction &i, unsigned int *sources) {
+	switch(i.op) {
+	case I_ADDU: case I_SUB: case I_SUBU: case I_AND: case I_OR: case I_XOR: case I_NOR:
+	case I_SLT: case I_SLTU: case I_SLLV: case I_SRLV: case I_SRAV:
+	case I_MULT: case I_DIV: case I_DIVU:
+	case I_BEQ: case I_BNE: case I_TEQ:
+		sources[0] = i.rs;
+		sources[1] = i.rt;
+		return 2;
+
+	case I_ADDI: case I_ADDIU: case I_ANDI: case I_ORI: case I_XORI: case I_SLTI: case I_SLTIU:
+	case I_SLL: case I_SRL: case I_SRA:
+	case I_MOVE: case I_LW: case I_JR:
+	case I_BLTZ: case I_BGEZ: case I_BLEZ: case I_BGTZ:
+		sources[0] = i.rs;
+		return 1;
+
+	case I_SW:
+		sources[0] = i.rd;
+		sources[1] = i.rs;
+		return 2;
+
+	default:
+		return 0;
+	}
+}
+
+unsigned int destinationRegister(const Instruction &i) {
+	switch(i.op) {
+	case I_ADDU: case I_SUB: case I_SUBU: case I_AND: case I_OR: case I_XOR: case I_NOR:
+	case I_SLT: case I_SLTU: case I_SLLV: case I_SRLV: case I_SRAV:
+	case I_ADDI: case I_ADDIU: case I_ANDI: case I_ORI: case I_XORI: case I_SLTI: case I_SLTIU:
+	case I_SLL: case I_SRL: case I_SRA:
+	case I_MFHI: case I_MFLO: case I_LI: case I_LUI: case I_MOVE: case I_LW:
+		return i.rd;
+
+	default:
+		return NO_REGISTER;
+	}
+}
+
+unsigned int registersUsed(const Instruction &i) {
+
+	if(i.op == I_JAL) {
+		// all four argument registers, we do not know how many the callee takes
+		return 0x000000f0 | registerBit(REG_GP) | registerBit(REG_SP);
+	}
+
+	unsigned int sources[2];
+	unsigned int n = sourceRegisters(i, sources);
+	unsigned int used = (i.op == I_MFHI || i.op == I_MFLO) ? HI_LO : 0;
+	for(unsigned int k = 0; k < n; k++) {
+		used = used | registerBit(sources[k]);
+	}
+	return used;
+}
+
+unsigned int registersDefined(const Instruction &i) {
+
+	if(i.op == I_JAL) {
+		return CALL_CLOBBERED | HI_LO;
+	}
+	if(i.op == I_MULT || i.op == I_DIV || i.op == I_DIVU) {
+		return HI_LO;
+	}
+
+	unsigned int rd = destinationRegister(i);
+	return (rd == NO_REGISTER) ? 0 : registerBit(rd);
+}
+
+bool sameAddress(const Instruction &a, const Instruction &b) {
+	return (a.rs == b.rs) && (a.reloc == b.reloc) && (a.imm == b.imm) && (a.symbol == b.symbol);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// BUILDING
+
+MachineFunction::MachineFunction(Symbol name_in)
+	: delaySlot(false), closed(true), name(name_in), frameSize(0), savedMask(0), savedOffset(0), framed(false), virtualCount(0)
+{}
+
+unsigned int MachineFunction::newLabel(const char *prefix, unsigned int number) {
+	LabelName l = {prefix, number};
+	labels.push_back(l);
+	return labels.size() - 1;
+}
+
+void MachineFunction::place(unsigned int label) {
+	BasicBlock b;
+	b.label = label;
+	blocks.push_back(b);
+	closed = false;
+	delaySlot = false;
+}
+
+unsigned int MachineFunction::newRegister() {
+	virtualCount++;
+	return FIRST_VIRTUAL + virtualCount - 1;
+}
+
+void MachineFunction::append(const Instruction &i) {
+
+	if(closed) {
+		// falling through into an unlabelled block
+		place(NO_LABEL);
+	}
+	blocks.back().code.push_back(i);
+
+	if(delaySlot) {
+		// that was the delay slot, the block ends here
+		closed = true;
+		delaySlot = false;
+	} else if(isBranch(i.op)) {
+		delaySlot = true;
+	}
+}
+
+void MachineFunction::emit(Opcode op, unsigned int rd, unsigned int rs, unsigned int rt, int imm) {
+	Instruction i = {op, RELOC_NONE, (Register)rd, (Register)rs, (Register)rt, imm, NO_SYMBOL};
+	append(i);
+}
+
+void MachineFunction::load(unsigned int rd, const Address &address) {
+	Instruction i = {I_LW, address.reloc, (Register)rd, address.base, 0, address.offset, address.symbol};
+	append(i);
+}
+
+void MachineFunction::store(unsigned int rd, const Address &address) {
+	Instruction i = {I_SW, address.reloc, (Register)rd, address.base, 0, address.offset, address.symbol};
+	append(i);
+}
+
+void MachineFunction::branch(Opcode op, unsigned int rs, unsigned int rt, unsigned int label) {
+	Instruction i = {op, RELOC_NONE, 0, (Register)rs, (Register)rt, (int)label, NO_SYMBOL};
+	append(i);
+}
+
+void MachineFunction::jump(unsigned int label) {
+	branch(I_B, 0, 0, label);
+}
+
+void MachineFunction::call(Symbol target) {
+	Instruction i = {I_JAL, RELOC_NONE, 0, 0, 0, 0, target};
+	append(i);
+}
+
+void MachineFunction::loadUpper(unsigned int rd, Reloc reloc, Symbol symbol) {
+	Instruction i = {I_LUI, reloc, (Register)rd, 0, 0, 0, symbol};
+	append(i);
+}
+
+unsigned int MachineFunction::instructionCount() const {
+	unsigned int n = 0;
+	for(unsigned int b = 0; b < blocks.size(); b++) {
+		n = n + blocks[b].code.size();
+	}
+	return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// ANALYSIS
+
+unsigned int MachineFunction::returned() const {
+	return framed ? (RETURN_LIVE | CALLEE_SAVED) : RETURN_LIVE;
+}
+
+unsigned int MachineFunction::liveness(const vector<Instruction> &code, unsigned int live, vector<unsigned int> *after) const {
+
+	if(after != NULL) {
+		after->resize(code.size());
+	}
+
+	for(int i = code.size() - 1; i >= 0; i--) {
+		if((i > 0) && (code[i - 1].op == I_JAL || code[i - 1].op == I_JR)) {
+			// the callee or caller sees what the delay slot did
+			const Instruction &jump = code[i - 1];
+			const Instruction &slot = code[i];
+			unsigned int end = live;
+			live = (live & ~registersDefined(jump)) | registersUsed(jump);
+			if(jump.op == I_JR) {
+				live = live | returned();
+			}
+			if(after != NULL) {
+				(*after)[i] = live;
+			}
+			live = (live & ~registersDefined(slot)) | registersUsed(slot);
+			if(after != NULL) {
+				(*after)[i - 1] = end | (*after)[i];
+			}
+			i--;
+			continue;
+		}
+		if(after != NULL) {
+			(*after)[i] = live;
+		}
+		live = (live & ~registersDefined(code[i])) | registersUsed(code[i]);
+		if(code[i].op == I_JR) {
+			live = live | returned();
+		}
+	}
+
+	return live;
+}
+
+vector<int> MachineFunction::labelBlocks() const {
+	vector<int> where(labels.size(), -1);
+	for(unsigned int b = 0; b < blocks.size(); b++) {
+		if(blocks[b].label != NO_LABEL) {
+			where[blocks[b].label] = b;
+		}
+	}
+	return where;
+}
+
+unsigned int MachineFunction::successors(unsigned int b, const vector<int> &where, int *next) const {
+
+	const vector<Instruction> &code = blocks[b].code;
+	unsigned int n = code.size();
+	unsigned int count = 0;
+	bool last = (b + 1 >= blocks.size());
+
+	// the branch is normally just before its delay slot, but a block
+	// may also end on the branch with its delay slot starting the next block
+	const Instruction *branch = NULL;
+	if((n >= 2) && isBranch(code[n - 2].op)) {
+		branch = &code[n - 2];
+	} else if((n >= 1) && isBranch(code[n - 1].op)) {
+		branch = &code[n - 1];
+		if(!last) {
+			next[count++] = b + 1;
+		}
+	}
+
+	if(branch == NULL || (branch->op != I_B && branch->op != I_JR)) {
+		// falls through
+		if(!last && (count == 0)) {
+			next[count++] = b + 1;
+		}
+	}
+	if(branch != NULL && branch->op != I_JR) {
+		next[count++] = where[branch->imm];
+	}
+	return count;
+}
+
+void MachineFunction::dropUnreachable() {
+
+	vector<int> where = labelBlocks();
+	vector<bool> reached(blocks.size(), false);
+	vector<unsigned int> work;
+	if(!blocks.empty()) {
+		reached[0] = true;
+		work.push_back(0);
+	}
+	while(!work.empty()) {
+		unsigned int b = work.back();
+		work.pop_back();
+		int next[2];
+		unsigned int n = successors(b, where, next);
+		for(unsigned int k = 0; k < n; k++) {
+			if((next[k] >= 0) && !reached[next[k]]) {
+				reached[next[k]] = true;
+				work.push_back(next[k]);
+			}
+		}
+	}
+
+	// a dropped block never fell into a kept one, that one would be reached too
+	unsigned int kept = 0;
+	for(unsigned int b = 0; b < blocks.size(); b++) {
+		if(reached[b]) {
+			if(kept != b) {
+				blocks[kept].label = blocks[b].label;
+				blocks[kept].code.swap(blocks[b].code);
+			}
+			kept++;
+		}
+	}
+	blocks.resize(kept);
+}
+
+vector<unsigned int> MachineFunction::liveOut() const {
+
+	vector<int> where = labelBlocks();
+	vector<unsigned int> in(blocks.size(), 0);
+	vector<unsigned int> out(blocks.size(), 0);
+
+	// backwards to a fixed point, loops need more than one round
+	bool changed = true;
+	while(changed) {
+		changed = false;
+
+		for(int b = blocks.size() - 1; b >= 0; b--) {
+			int next[2];
+			unsigned int count = successors(b, where, next);
+			unsigned int live = 0;
+			for(unsigned int k = 0; k < count; k++) {
+				if(next[k] < 0) {
+					// jumps somewhere we cannot see, assume everything is needed
+					live = 0xffffffff;
+				} else {
+					live = live | in[next[k]];
+				}
+			}
+			out[b] = live;
+
+			live = liveness(blocks[b].code, live, NULL);
+			if(live != in[b]) {
+				in[b] = live;
+				changed = true;
+			}
+		}
+	}
+
+	return out;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// PRINTING
+
+// as gcc prints them, numbers except for the frame registers
+static const char *registerNames[32] = {
+	"$0", "$1", "$2", "$3", "$4", "$5", "$6", "$7",
+	"$8", "$9", "$10", "$11", "$12", "$13", "$14", "$15",
+	"$16", "$17", "$18", "$19", "$20", "$21", "$22", "$23",
+	"$24", "$25", "$26", "$27", "$28", "$sp", "$fp", "$ra"
+};
+
+static void printReg(AsmEmitter &out, unsigned int r) {
+	if(r < FIRST_VIRTUAL) {
+		out << registerNames[r];
+	} else {
+		// only seen when printing before allocation
+		out << "$vr" << (r - FIRST_VIRTUAL);
+	}
+}
+
+void MachineFunction::printLabel(AsmEmitter &out, unsigned int label) const {
+	out << labels[label].prefix << labels[label].number << '_' << spelling(name);
+}
+
+void MachineFunction::printInstruction(AsmEmitter &out, const Instruction &i) const {
+
+	if(i.op == I_JAL) {
+		// calls are absolute, not through $25
+		out << "    .option     pic0\n";
+	}
+
+	out << mnemonics[i.op];
+
+	switch(i.op) {
+	case I_ADDU: case I_SUB: case I_SUBU: case I_AND: case I_OR: case I_XOR: case I_NOR:
+	case I_SLT: case I_SLTU: case I_SLLV: case I_SRLV: case I_SRAV:
+		printReg(out, i.rd);
+		out << ", ";
+		printReg(out, i.rs);
+		out << ", ";
+		printReg(out, i.rt);
+		break;
+
+	case I_ADDI: case I_ADDIU: case I_ANDI: case I_ORI: case I_XORI: case I_SLTI: case I_SLTIU:
+	case I_SLL: case I_SRL: case I_SRA:
+		printReg(out, i.rd);
+		out << ", ";
+		printReg(out, i.rs);
+		out << ", " << i.imm;
+		break;
+
+	case I_MULT: case I_DIV: case I_DIVU:
+		printReg(out, i.rs);
+		out << ", ";
+		printReg(out, i.rt);
+		break;
+
+	case I_MFHI: case I_MFLO:
+		printReg(out, i.rd);
+		break;
+
+	case I_LI:
+		printReg(out, i.rd);
+		out << ", " << i.imm;
+		break;
+
+	case I_LUI:
+		printReg(out, i.rd);
+		out << ", ";
+		if(i.reloc != RELOC_NONE) {
+			out << relocations[i.reloc] << spelling(i.symbol) << ')';
+		} else {
+			out << i.imm;
+		}
+		break;
+
+	case I_MOVE:
+		printReg(out, i.rd);
+		out << ", ";
+		printReg(out, i.rs);
+		break;
+
+	case I_LW: case I_SW:
+		printReg(out, i.rd);
+		out << ", ";
+		if(i.reloc != RELOC_NONE) {
+			out << relocations[i.reloc] << spelling(i.symbol) << ')';
+		} else {
+			out << i.imm;
+		}
+		out << '(';
+		printReg(out, i.rs);
+		out << ')';
+		break;
+
+	case I_B:
+		printLabel(out, i.imm);
+		break;
+
+	case I_BEQ: case I_BNE:
+		printReg(out, i.rs);
+		out << ", ";
+		printReg(out, i.rt);
+		out << ", ";
+		printLabel(out, i.imm);
+		break;
+
+	case I_BLTZ: case I_BGEZ: case I_BLEZ: case I_BGTZ:
+		printReg(out, i.rs);
+		out << ", ";
+		printLabel(out, i.imm);
+		break;
+
+	case I_JAL:
+		out << spelling(i.symbol);
+		break;
+
+	case I_JR:
+		printReg(out, i.rs);
+		break;
+
+	case I_TEQ:
+		printReg(out, i.rs);
+		out << ", ";
+		printReg(out, i.rt);
+		out << ", " << i.imm;
+		break;
+
+	case I_NOP:
+		break;
+	}
+
+	out << '\n';
+}
+
+void MachineFunction::print(AsmEmitter &out) const {
+
+	// .text stuff
+	out << "    .text       \n";
+	out << "    .align      2\n";
+	out << "    .globl      " << spelling(name) << '\n';
+	out << "    .set        nomips16\n";
+	out << "    .set        nomicromips\n";
+	out << "    .ent        " << spelling(name) << '\n';
+	out << "    .type       " << spelling(name) << ", @function\n";
+
+	// function label
+	out << spelling(name) << ":\n";
+
+	// more .text stuff
+	char mask[16];
+	snprintf(mask, sizeof(mask), "0x%08x", savedMask);
+	out << "    .frame      $sp, " << frameSize << ", $31\n";
+	out << "    .mask       " << mask << ", " << savedOffset << '\n';
+	out << "    .fmask      0x00000000, 0\n";
+	out << "    .set        noreorder\n";
+	out << "    .set        nomacro\n";
+
+	for(unsigned int b = 0; b < blocks.size(); b++) {
+		if(blocks[b].label != NO_LABEL) {
+			printLabel(out, blocks[b].label);
+			out << ":\n";
+		}
+		for(unsigned int i = 0; i < blocks[b].code.size(); i++) {
+			printInstruction(out, blocks[b].code[i]);
+		}
+	}
+
+	// .text stuff
+	out << "    .set        macro\n";
+	out << "    .set        reorder\n";
+	out << "    .end        " << spelling(name) << '\n';
+	out << "    .size       " << spelling(name) << ", .-" << spelling(name) << '\n';
+	out << '\n';
+}
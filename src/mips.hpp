@@ -0,0 +1,216 @@
+#ifndef mips_hpp
+#define mips_hpp
+
+#include <vector>
+
+#include "symbol.hpp"
+#include "emitter.hpp"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// REGISTERS
+
+const unsigned int REG_ZERO = 0;
+const unsigned int REG_V0 = 2;
+const unsigned int REG_A0 = 4;
+const unsigned int REG_T8 = 24;
+const unsigned int REG_T9 = 25;
+const unsigned int REG_GP = 28;
+const unsigned int REG_SP = 29;
+const unsigned int REG_FP = 30;
+const unsigned int REG_RA = 31;
+
+// Numbers from here on are virtual registers, handed out by the code
+// generator without limit and mapped to the ones above by allocateRegisters().
+const unsigned int FIRST_VIRTUAL = 32;
+
+typedef unsigned short Register;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// INSTRUCTIONS
+
+enum Opcode : unsigned char {
+	// rd = rs op rt
+	I_ADDU, I_SUB, I_SUBU, I_AND, I_OR, I_XOR, I_NOR, I_SLT, I_SLTU, I_SLLV, I_SRLV, I_SRAV,
+	// rd = rs op imm
+	I_ADDI, I_ADDIU, I_ANDI, I_ORI, I_XORI, I_SLTI, I_SLTIU, I_SLL, I_SRL, I_SRA,
+	// hi/lo = rs op rt, rd = hi/lo
+	I_MULT, I_DIV, I_DIVU, I_MFHI, I_MFLO,
+	// rd = imm (or %hi(symbol) for lui), rd = rs
+	I_LI, I_LUI, I_MOVE,
+	// rd = memory, memory = rd; the address is imm(rs)
+	I_LW, I_SW,
+	// branch to label imm, comparing rs with rt
+	I_B, I_BEQ, I_BNE,
+	// branch to label imm on the sign of rs: < 0, >= 0, <= 0, > 0
+	I_BLTZ, I_BGEZ, I_BLEZ, I_BGTZ,
+	// call symbol, return through rs
+	I_JAL, I_JR,
+	// trap with code imm if rs equals rt
+	I_TEQ,
+	I_NOP
+};
+
+// how a symbol in an immediate or address is relocated
+enum Reloc : unsigned char {
+	RELOC_NONE, RELOC_HI, RELOC_LO, RELOC_GOT
+};
+
+// One machine instruction in 16 bytes. Unused fields are zero (NO_SYMBOL for symbol).
+struct Instruction {
+	Opcode op;
+	Reloc reloc;														// how imm or symbol is relocated
+	Register rd;														// destination, or the value stored by sw
+	Register rs;														// first source, base register of loads and stores
+	Register rt;														// second source
+	int imm;															// immediate, memory offset or label id
+	Symbol symbol;														// relocated symbol or call target
+};
+
+// where a variable lives: offset(base), or a relocated symbol
+struct Address {
+	Register base;
+	Reloc reloc;
+	int offset;
+	Symbol symbol;
+};
+
+inline Address offsetAddress(unsigned int base, int offset) {
+	Address a = {(Register)base, RELOC_NONE, offset, NO_SYMBOL};
+	return a;
+}
+
+bool isBranch(Opcode op);
+
+// branches and calls, the instruction after them runs before they take effect
+bool hasDelaySlot(Opcode op);
+
+// instructions whose only effect is writing rd
+bool isPure(Opcode op);
+
+// Registers as bit masks, bit r for register r. What an instruction reads
+// and writes; a call writes every register the callee may clobber. What a
+// return hands back to the caller depends on the function, see
+// MachineFunction::returned().
+inline unsigned int registerBit(unsigned int r) {
+	return (r == REG_ZERO || r >= FIRST_VIRTUAL) ? 0 : (1u << r);
+}
+
+// $0 never carries a value from one instruction to another, so its bit
+// stands for hi and lo: written by mult and div, read by mfhi and mflo
+const unsigned int HI_LO = 1;
+
+// The register fields an instruction reads (at most two, returned in
+// sources) and the one it writes (or NO_REGISTER), virtual ones included.
+// Calls and returns only count the fields, not what they imply.
+const unsigned int NO_REGISTER = 0xffff;
+unsigned int sourceRegisters(const Instruction &i, unsigned int *sources);
+unsigned int destinationRegister(const Instruction &i);
+
+unsigned int registersUsed(const Instruction &i);
+unsigned int registersDefined(const Instruction &i);
+
+// whether k fits an immediate that is sign or zero extended
+inline bool fitsSigned(long long k) {
+	return (k >= -32768) && (k <= 32767);
+}
+
+inline bool fitsUnsigned(long long k) {
+	return (k >= 0) && (k <= 65535);
+}
+
+// true if the two instructions access the same memory word through the same base
+bool sameAddress(const Instruction &a, const Instruction &b);
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// FUNCTIONS
+
+const unsigned int NO_LABEL = 0xffffffff;
+
+// Straight-line code: entered only at the top (through its label or by
+// falling into it) and left only by the branch that ends it, whose delay
+// slot is the block's last instruction.
+struct BasicBlock {
+	unsigned int label;													// id in MachineFunction::labels, or NO_LABEL
+	std::vector<Instruction> code;
+};
+
+// a label prints as <prefix><number>_<function>
+struct LabelName {
+	const char *prefix;
+	unsigned int number;
+};
+
+// The code of one function, kept in memory so it can be inspected and
+// rewritten before print() turns it into text.
+class MachineFunction {
+private:
+	bool delaySlot;														// the last instruction was a branch
+	bool closed;														// the current block has ended
+
+	void printInstruction(AsmEmitter &out, const Instruction &i) const;
+	void printLabel(AsmEmitter &out, unsigned int label) const;
+
+public:
+	Symbol name;
+	unsigned int frameSize;												// for the .frame directive
+	unsigned int savedMask;												// registers saved in the frame, for .mask
+	int savedOffset;													// where the highest of them is, from the top of the frame
+	bool framed;														// the prologue and epilogues are in place
+	unsigned int virtualCount;											// virtual registers handed out so far
+
+	std::vector<LabelName> labels;
+	std::vector<BasicBlock> blocks;
+
+	MachineFunction(Symbol name_in);
+
+	// label ids are only valid in the function that made them
+	unsigned int newLabel(const char *prefix, unsigned int number);
+
+	// start a new block at label
+	void place(unsigned int label);
+
+	// a virtual register nothing else uses yet
+	unsigned int newRegister();
+
+	void append(const Instruction &i);
+
+	// building instructions
+	void emit(Opcode op, unsigned int rd = 0, unsigned int rs = 0, unsigned int rt = 0, int imm = 0);
+	void load(unsigned int rd, const Address &address);
+	void store(unsigned int rd, const Address &address);
+	void branch(Opcode op, unsigned int rs, unsigned int rt, unsigned int label);
+	void jump(unsigned int label);
+	void call(Symbol target);
+	void loadUpper(unsigned int rd, Reloc reloc, Symbol symbol);
+
+	unsigned int instructionCount() const;
+
+	// index of the block placed at each label, -1 for labels never placed
+	std::vector<int> labelBlocks() const;
+
+	// Registers the caller sees when this function returns: the result, the
+	// stack, and once the frame is built $16-$23. Before that the body may
+	// leave anything in them, the epilogue restores them.
+	unsigned int returned() const;
+
+	// Walk code backwards from the registers live at its end and return those
+	// live at its start. If after is not NULL it gets the registers live after
+	// each instruction. The delay slot of a call or return is taken to run
+	// before the jump, which is when its effects are seen.
+	unsigned int liveness(const std::vector<Instruction> &code, unsigned int live, std::vector<unsigned int> *after) const;
+
+	// Blocks control may go to from the end of block b, at most two, returned
+	// in next. where is labelBlocks(), a jump to a label never placed gives -1.
+	unsigned int successors(unsigned int b, const std::vector<int> &where, int *next) const;
+
+	// registers live on leaving each block, indexed like blocks
+	std::vector<unsigned int> liveOut() const;
+
+	// Remove the blocks control never gets to from the first, such as code
+	// after a return. Their labels are left unplaced.
+	void dropUnreachable();
+
+	void print(AsmEmitter &out) const;
+
+};
+
+
+#endif
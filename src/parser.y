@@ -1,17 +1,26 @@
 %code requires{
   #include "ast.hpp"
+  #include "symbol.hpp"
+  #include "compilation.hpp"
+  #include "fold.hpp"
 
   #include <cassert>
+}
 
-  extern const ASTnode *g_root; // A way of getting the AST out
-
+%code provides{
   //! This is to fix problems when generating C++
   // We are declaring the functions provided by Flex, so
   // that Bison generated code can call them.
-  int yylex(void);
-  void yyerror(const char *);
+  int yylex(YYSTYPE *yylval_param, void *scanner);
+  void yyerror(Compilation &unit, void *scanner, const char *);
 }
 
+// reentrant: the AST goes into the translation unit's Compilation (nodes
+// come from its arena) and the scanner state is passed in explicitly
+%define api.pure full
+%lex-param { void *scanner }
+%parse-param { Compilation &unit } { void *scanner }
+
 // Represents the value associated with any kind of
 // AST node.
 %union{
@@ -25,7 +34,9 @@
 	const Expression *expression;
 	Statement *statement;
 	StatementSequence *statement_sequence;
-	const std::string *my_string;
+	Symbol my_symbol;
+	BinaryOp binary_op;
+	UnaryOp unary_op;
 	const int *my_int;
 }
 
@@ -51,50 +62,50 @@
 %type <expression> EXPR BIN_EXPR COMP_EXPR UN_EXPR ID_EXPR FN_EXPR CONST_EXPR EXPR_STAT
 %type <statement> STAT ASS_STAT IF_STAT IFELSE_STAT WHILE_STAT DOWHILE_STAT FOR_STAT RET_STAT
 %type <statement_sequence> STAT_SEQ
-%type <my_string> T_INT T_VOID T_RET T_ID T_IF T_ELSE T_WHILE T_DO T_FOR TYPE
-%type <my_string> BIN_OP T_PLUS T_MINUS T_STAR T_DIV T_AND T_OR T_LEFT T_RIGHT
-%type <my_string> COMP_OP T_LE T_GE T_EQ2 T_NEQ T_AND2 T_OR2 T_LT T_GT UN_OP T_INCR T_DECR T_EXCL
-%type <my_string> T_NUM
+%type <my_symbol> T_INT T_VOID T_RET T_ID T_IF T_ELSE T_WHILE T_DO T_FOR TYPE
+%type <binary_op> BIN_OP COMP_OP
+%type <unary_op> UN_OP
+%type <my_symbol> T_NUM
 
 %start ROOT
 
 %%
 
-ROOT : PROGRAM 									{ g_root = $1; }
+ROOT : PROGRAM 									{ unit.root = $1; }
 
-PROGRAM : VAR_DEC T_SEMICOL						{ $$ = new Program($1); }
-        | FUN_DEC								{ $$ = new Program($1); }
-        | VAR_DEC T_SEMICOL PROGRAM				{ $$ = new Program($1, $3); }
-        | FUN_DEC PROGRAM						{ $$ = new Program($1, $2); }
+PROGRAM : VAR_DEC T_SEMICOL						{ $$ = new (unit.arena) Program($1); }
+        | FUN_DEC								{ $$ = new (unit.arena) Program($1); }
+        | VAR_DEC T_SEMICOL PROGRAM				{ $$ = new (unit.arena) Program($1, $3); }
+        | FUN_DEC PROGRAM						{ $$ = new (unit.arena) Program($1, $2); }
 
-FUN_DEC : TYPE T_ID T_LPAR T_RPAR T_SEMICOL				{ $$ = new FunDec($1, $2, NULL, NULL); }
-        | TYPE T_ID T_LPAR PAR_SEQ T_RPAR T_SEMICOL		{ $$ = new FunDec($1, $2, $4,   NULL); }
-        | TYPE T_ID T_LPAR T_RPAR SCOPE					{ $$ = new FunDec($1, $2, NULL, $5  ); }
-        | TYPE T_ID T_LPAR PAR_SEQ T_RPAR SCOPE			{ $$ = new FunDec($1, $2, $4,   $6  ); }
+FUN_DEC : TYPE T_ID T_LPAR T_RPAR T_SEMICOL				{ $$ = new (unit.arena) FunDec($1, $2, NULL, NULL); }
+        | TYPE T_ID T_LPAR PAR_SEQ T_RPAR T_SEMICOL		{ $$ = new (unit.arena) FunDec($1, $2, $4,   NULL); }
+        | TYPE T_ID T_LPAR T_RPAR SCOPE					{ $$ = new (unit.arena) FunDec($1, $2, NULL, $5  ); }
+        | TYPE T_ID T_LPAR PAR_SEQ T_RPAR SCOPE			{ $$ = new (unit.arena) FunDec($1, $2, $4,   $6  ); }
 
-SCOPE : T_LBRA T_RBRA							{ $$ = new Scope(); }
-      | T_LBRA VAR_SEQ T_RBRA					{ $$ = new Scope($2); }
-      | T_LBRA STAT_SEQ T_RBRA					{ $$ = new Scope($2); }
-      | T_LBRA VAR_SEQ STAT_SEQ T_RBRA			{ $$ = new Scope($2, $3); }
+SCOPE : T_LBRA T_RBRA							{ $$ = new (unit.arena) Scope(); }
+      | T_LBRA VAR_SEQ T_RBRA					{ $$ = new (unit.arena) Scope($2); }
+      | T_LBRA STAT_SEQ T_RBRA					{ $$ = new (unit.arena) Scope($2); }
+      | T_LBRA VAR_SEQ STAT_SEQ T_RBRA			{ $$ = new (unit.arena) Scope($2, $3); }
 
-PAR_SEQ : PAR_DEC								{ $$ = new ParamSeq(); $$->addDeclaration($1); }
+PAR_SEQ : PAR_DEC								{ $$ = new (unit.arena) ParamSeq(unit.arena); $$->addDeclaration($1); }
 		| PAR_SEQ T_COMM PAR_DEC	    		{ $$ = $1; $$->addDeclaration($3); }
 
-PAR_DEC : TYPE T_ID 							{ $$ = new ParamDec($1, $2); }
+PAR_DEC : TYPE T_ID 							{ $$ = new (unit.arena) ParamDec($1, $2); }
 
-ARG_SEQ : EXPR									{ $$ = new ArgSeq(); $$->addDeclaration($1); }
+ARG_SEQ : EXPR									{ $$ = new (unit.arena) ArgSeq(unit.arena); $$->addDeclaration($1); }
 		| ARG_SEQ T_COMM EXPR					{ $$ = $1; $$->addDeclaration($3); }
 
-VAR_SEQ : VAR_DEC T_SEMICOL						{ $$ = new VarSeq(); $$->addDeclaration($1); }
+VAR_SEQ : VAR_DEC T_SEMICOL						{ $$ = new (unit.arena) VarSeq(unit.arena); $$->addDeclaration($1); }
 		| VAR_SEQ VAR_DEC T_SEMICOL	    		{ $$ = $1; $$->addDeclaration($2); }
 
-VAR_DEC : TYPE T_ID 							{ $$ = new VarDec($1, $2, NULL); }
-		| TYPE T_ID T_EQ EXPR					{ $$ = new VarDec($1, $2, $4  ); }
+VAR_DEC : TYPE T_ID 							{ $$ = new (unit.arena) VarDec($1, $2, NULL); }
+		| TYPE T_ID T_EQ EXPR					{ $$ = new (unit.arena) VarDec($1, $2, $4  ); }
 
-STAT_SEQ : STAT									{ $$ = new StatementSequence(); $$->addStatement($1); }
+STAT_SEQ : STAT									{ $$ = new (unit.arena) StatementSequence(unit.arena); $$->addStatement($1); }
 		 | STAT_SEQ STAT			    		{ $$ = $1; $$->addStatement($2); }
 
-STAT : EXPR_STAT								{ $$ = new ExpressionStatement($1); }
+STAT : EXPR_STAT								{ $$ = new (unit.arena) ExpressionStatement($1); }
      | ASS_STAT									{ $$ = $1; }
 	 | IF_STAT									{ $$ = $1; }
 	 | IFELSE_STAT								{ $$ = $1; }
@@ -102,17 +113,17 @@ STAT : EXPR_STAT								{ $$ = new ExpressionStatement($1); }
 	 | DOWHILE_STAT								{ $$ = $1; }
 	 | FOR_STAT	 								{ $$ = $1; }
 	 | RET_STAT									{ $$ = $1; }
-	 | SCOPE_STAT								{ $$ = new ScopeStatement($1); }
+	 | SCOPE_STAT								{ $$ = new (unit.arena) ScopeStatement($1); }
 
 EXPR_STAT : EXPR 								{ $$ = $1; }
 		  | EXPR T_SEMICOL						{ $$ = $1; }
 
 SCOPE_STAT : SCOPE								{ $$ = $1; }		  
 
-ASS_STAT : T_ID T_EQ EXPR T_SEMICOL				{ $$ = new AssignmentStatement($1, $3); }
+ASS_STAT : T_ID T_EQ EXPR T_SEMICOL				{ $$ = new (unit.arena) AssignmentStatement($1, $3); }
 
-RET_STAT : T_RET EXPR T_SEMICOL					{ $$ = new ReturnStatement($2); }
-		 | T_RET T_SEMICOL						{ $$ = new ReturnStatement(NULL); }
+RET_STAT : T_RET EXPR T_SEMICOL					{ $$ = new (unit.arena) ReturnStatement($2); }
+		 | T_RET T_SEMICOL						{ $$ = new (unit.arena) ReturnStatement(NULL); }
 
 EXPR : BIN_EXPR									{ $$ = $1; }
 	 | COMP_EXPR								{ $$ = $1; }
@@ -122,62 +133,54 @@ EXPR : BIN_EXPR									{ $$ = $1; }
 	 | CONST_EXPR								{ $$ = $1; }
 	 | T_LPAR EXPR T_RPAR						{ $$ = $2; }
 
-BIN_EXPR : EXPR BIN_OP EXPR						{ $$ = new BinaryExpression($1, $2, $3); }
+BIN_EXPR : EXPR BIN_OP EXPR						{ $$ = fold(unit.arena, $1, $2, $3); }
 
-COMP_EXPR : EXPR COMP_OP EXPR					{ $$ = new BinaryExpression($1, $2, $3); }
+COMP_EXPR : EXPR COMP_OP EXPR					{ $$ = fold(unit.arena, $1, $2, $3); }
 
-BIN_OP : T_PLUS									{ $$ = new std::string("+"); }
-       | T_MINUS								{ $$ = new std::string("-"); }
-       | T_STAR									{ $$ = new std::string("*"); }
-       | T_DIV									{ $$ = new std::string("/"); }
-       | T_AND									{ $$ = new std::string("&"); }
-       | T_OR									{ $$ = new std::string("|"); }
-	   | T_LEFT									{ $$ = new std::string("<<"); }
-	   | T_RIGHT								{ $$ = new std::string(">>"); }
+BIN_OP : T_PLUS									{ $$ = OP_ADD; }
+       | T_MINUS								{ $$ = OP_SUB; }
+       | T_STAR									{ $$ = OP_MUL; }
+       | T_DIV									{ $$ = OP_DIV; }
+       | T_PERCENT								{ $$ = OP_MOD; }
+       | T_AND									{ $$ = OP_AND; }
+       | T_OR									{ $$ = OP_OR; }
+	   | T_LEFT									{ $$ = OP_SHL; }
+	   | T_RIGHT								{ $$ = OP_SHR; }
 
-UN_EXPR : T_ID UN_OP							{ $$ = new UnaryExpression($1, $2); }
-        | UN_OP T_ID							{ $$ = new UnaryExpression($2, $1); }
+UN_EXPR : T_ID UN_OP							{ $$ = new (unit.arena) UnaryExpression($1, $2); }
+        | UN_OP T_ID							{ $$ = new (unit.arena) UnaryExpression($2, $1); }
        
-UN_OP : T_INCR									{ $$ = new std::string("++"); }
-      | T_DECR									{ $$ = new std::string("--"); }
-      | T_EXCL									{ $$ = new std::string("!"); }
+UN_OP : T_INCR									{ $$ = OP_INCR; }
+      | T_DECR									{ $$ = OP_DECR; }
+      | T_EXCL									{ $$ = OP_NOT; }
 
-COMP_OP : T_LE									{ $$ = new std::string("<="); }
-        | T_GE									{ $$ = new std::string(">="); }
-        | T_EQ2									{ $$ = new std::string("=="); }
-        | T_NEQ									{ $$ = new std::string("!="); }
-		| T_AND2								{ $$ = new std::string("&&"); }
-		| T_OR2									{ $$ = new std::string("||"); }
-        | T_LT									{ $$ = new std::string("<"); }
-        | T_GT									{ $$ = new std::string(">"); }
+COMP_OP : T_LE									{ $$ = OP_LE; }
+        | T_GE									{ $$ = OP_GE; }
+        | T_EQ2									{ $$ = OP_EQ; }
+        | T_NEQ									{ $$ = OP_NE; }
+		| T_AND2								{ $$ = OP_LAND; }
+		| T_OR2									{ $$ = OP_LOR; }
+        | T_LT									{ $$ = OP_LT; }
+        | T_GT									{ $$ = OP_GT; }
 
-ID_EXPR : T_ID	 								{ $$ = new IdentifierExpression($1); }
+ID_EXPR : T_ID	 								{ $$ = new (unit.arena) IdentifierExpression($1); }
 
-FN_EXPR : T_ID T_LPAR T_RPAR	 				{ $$ = new FunctionExpression($1, NULL); }
-		| T_ID T_LPAR ARG_SEQ T_RPAR			{ $$ = new FunctionExpression($1, $3  ); }
+FN_EXPR : T_ID T_LPAR T_RPAR	 				{ $$ = new (unit.arena) FunctionExpression($1, NULL); }
+		| T_ID T_LPAR ARG_SEQ T_RPAR			{ $$ = new (unit.arena) FunctionExpression($1, $3  ); }
 
-CONST_EXPR : T_NUM								{ $$ = new ConstantExpression($1); }
+CONST_EXPR : T_NUM								{ $$ = new (unit.arena) ConstantExpression($1); }
 
-IF_STAT : T_IF T_LPAR EXPR T_RPAR STAT 			{ $$ = new IfStatement($3, $5); }
+IF_STAT : T_IF T_LPAR EXPR T_RPAR STAT 			{ $$ = new (unit.arena) IfStatement($3, $5); }
 
-IFELSE_STAT : T_IF T_LPAR EXPR T_RPAR STAT T_ELSE STAT				{ $$ = new IfElseStatement($3, $5, $7); }
+IFELSE_STAT : T_IF T_LPAR EXPR T_RPAR STAT T_ELSE STAT				{ $$ = new (unit.arena) IfElseStatement($3, $5, $7); }
 
-WHILE_STAT : T_WHILE T_LPAR EXPR T_RPAR SCOPE						{ $$ = new WhileStatement($3, $5); }
+WHILE_STAT : T_WHILE T_LPAR EXPR T_RPAR SCOPE						{ $$ = new (unit.arena) WhileStatement($3, $5); }
 
-DOWHILE_STAT : T_DO SCOPE T_WHILE T_LPAR EXPR T_RPAR T_SEMICOL		{ $$ = new DoWhileStatement($2, $5); }
+DOWHILE_STAT : T_DO SCOPE T_WHILE T_LPAR EXPR T_RPAR T_SEMICOL		{ $$ = new (unit.arena) DoWhileStatement($2, $5); }
 
-FOR_STAT : T_FOR T_LPAR STAT STAT STAT T_RPAR SCOPE					{ $$ = new ForStatement($3, $4, $5, $7);}
+FOR_STAT : T_FOR T_LPAR STAT STAT STAT T_RPAR SCOPE					{ $$ = new (unit.arena) ForStatement($3, $4, $5, $7);}
 
-TYPE : T_INT									{ $$ = new std::string("int"); }
-     | T_VOID									{ $$ = new std::string("void"); }
+TYPE : T_INT									{ $$ = $1; }
+     | T_VOID									{ $$ = $1; }
 
 %%
-
-const ASTnode *g_root; // Definition of variable (to match declaration earlier)
-
-const ASTnode *parseAST() {
-	g_root=0;
-	yyparse();
-	return g_root;
-}
-
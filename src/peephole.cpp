@@ -0,0 +1,374 @@
+#include "peephole.hpp"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// WINDOW
+
+// The rewritten block so far; rules look at its last few instructions.
+struct Window {
+	vector<Instruction> code;
+	vector<unsigned int> liveAfter;										// registers live after each instruction, may be too many but never too few
+	unsigned int fixed;													// leading instructions no rule may touch
+
+	// 0 is the newest instruction, 1 the one before it
+	Instruction &at(unsigned int back) {
+		return code[code.size() - 1 - back];
+	}
+
+	unsigned int liveAt(unsigned int back) const {
+		return liveAfter[liveAfter.size() - 1 - back];
+	}
+
+	void erase(unsigned int back);
+};
+
+void Window::erase(unsigned int back) {
+
+	unsigned int i = code.size() - 1 - back;
+
+	if(i > 0) {
+		// whatever was live after the erased instruction is now live after the one before
+		liveAfter[i - 1] = liveAfter[i - 1] | liveAfter[i];
+	}
+	code.erase(code.begin() + i);
+	liveAfter.erase(liveAfter.begin() + i);
+}
+
+// read register to instead of from wherever i reads it
+static void replaceUses(Instruction &i, unsigned int from, unsigned int to) {
+	unsigned int used = registersUsed(i);
+	if(i.op == I_SW && i.rd == from) {
+		i.rd = to;
+	}
+	if((used & registerBit(i.rs)) && i.rs == from) {
+		i.rs = to;
+	}
+	if((used & registerBit(i.rt)) && i.rt == from) {
+		i.rt = to;
+	}
+}
+
+// can the value r has before i be forgotten once i has read it
+static bool diesAt(const Instruction &i, unsigned int liveAfter, unsigned int r) {
+	return !(liveAfter & registerBit(r)) || (registersDefined(i) & registerBit(r));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// RULES
+
+// sw r, A; lw r, A  =>  sw r, A
+// sw r, A; lw s, A  =>  sw r, A; move s, r
+static bool storeLoad(Window &w) {
+	Instruction &store = w.at(1);
+	Instruction &load = w.at(0);
+	if(store.op != I_SW || load.op != I_LW || !sameAddress(store, load)) {
+		return false;
+	}
+	if(load.rd == store.rd) {
+		w.erase(0);
+	} else {
+		Instruction move = {I_MOVE, RELOC_NONE, load.rd, store.rd, 0, 0, NO_SYMBOL};
+		load = move;
+	}
+	return true;
+}
+
+// lw r, A; sw r, A  =>  lw r, A
+static bool loadStore(Window &w) {
+	Instruction &load = w.at(1);
+	Instruction &store = w.at(0);
+	if(load.op != I_LW || store.op != I_SW || !sameAddress(store, load)) {
+		return false;
+	}
+	if(load.rd != store.rd || load.rd == load.rs) {
+		return false;
+	}
+	w.erase(0);
+	return true;
+}
+
+// sw r, A; sw s, A  =>  sw s, A
+static bool storeStore(Window &w) {
+	if(w.at(1).op != I_SW || w.at(0).op != I_SW || !sameAddress(w.at(1), w.at(0))) {
+		return false;
+	}
+	w.erase(1);
+	return true;
+}
+
+// lw r, A; lw s, A  =>  lw r, A; move s, r
+static bool loadLoad(Window &w) {
+	Instruction &first = w.at(1);
+	Instruction &second = w.at(0);
+	if(first.op != I_LW || second.op != I_LW || !sameAddress(first, second) || first.rd == first.rs) {
+		return false;
+	}
+	if(second.rd == first.rd) {
+		w.erase(0);
+	} else {
+		Instruction move = {I_MOVE, RELOC_NONE, second.rd, first.rd, 0, 0, NO_SYMBOL};
+		second = move;
+	}
+	return true;
+}
+
+// move r, r  =>
+static bool selfMove(Window &w) {
+	if(w.at(0).op != I_MOVE || w.at(0).rd != w.at(0).rs) {
+		return false;
+	}
+	w.erase(0);
+	return true;
+}
+
+// move d, s; op ..d..  =>  op ..s..  when d is not needed afterwards
+static bool forwardMove(Window &w) {
+	Instruction &move = w.at(1);
+	Instruction &user = w.at(0);
+	if(move.op != I_MOVE || move.rd == REG_ZERO || user.op == I_JAL || user.op == I_JR) {
+		return false;
+	}
+	if(!(registersUsed(user) & registerBit(move.rd)) || !diesAt(user, w.liveAt(0), move.rd)) {
+		return false;
+	}
+	replaceUses(user, move.rd, move.rs);
+	w.erase(1);
+	return true;
+}
+
+// op r, ...; move d, r  =>  op d, ...  when r is not needed afterwards
+static bool retarget(Window &w) {
+	Instruction &def = w.at(1);
+	Instruction &move = w.at(0);
+	if(move.op != I_MOVE || !isPure(def.op) || def.rd != move.rs || def.rd == REG_ZERO) {
+		return false;
+	}
+	if(w.liveAt(0) & registerBit(move.rs)) {
+		return false;
+	}
+	def.rd = move.rd;
+	w.erase(0);
+	return true;
+}
+
+// li r, 0; op ..r..  =>  op ..$0..  when r is not needed afterwards
+static bool zeroConstant(Window &w) {
+	Instruction &li = w.at(1);
+	Instruction &user = w.at(0);
+	if(li.op != I_LI || li.imm != 0 || li.rd == REG_ZERO || user.op == I_JAL || user.op == I_JR) {
+		return false;
+	}
+	if(!(registersUsed(user) & registerBit(li.rd)) || !diesAt(user, w.liveAt(0), li.rd)) {
+		return false;
+	}
+	replaceUses(user, li.rd, REG_ZERO);
+	w.erase(1);
+	return true;
+}
+
+// li r, k; op d, s, r  =>  opi d, s, k  when r is not needed afterwards and k fits
+static bool immediateOperand(Window &w) {
+	Instruction &li = w.at(1);
+	Instruction &user = w.at(0);
+	unsigned int r = li.rd;
+	if(li.op != I_LI || r == REG_ZERO || !diesAt(user, w.liveAt(0), r)) {
+		return false;
+	}
+
+	long long k = li.imm;
+	Opcode op;
+	unsigned int source;
+
+	// operands that commute may have the constant on either side
+	bool right = (user.rt == r) && (user.rs != r);
+	bool left = (user.rs == r) && (user.rt != r);
+
+	switch(user.op) {
+	case I_ADDU:
+		if(!(left || right) || !fitsSigned(k)) {
+			return false;
+		}
+		op = I_ADDIU;
+		source = right ? user.rs : user.rt;
+		break;
+
+	case I_SUB: case I_SUBU:
+		if(!right || !fitsSigned(-k)) {
+			return false;
+		}
+		op = I_ADDIU;
+		source = user.rs;
+		k = -k;
+		break;
+
+	case I_AND: case I_OR: case I_XOR:
+		if(!(left || right) || !fitsUnsigned(k)) {
+			return false;
+		}
+		op = (user.op == I_AND) ? I_ANDI : ((user.op == I_OR) ? I_ORI : I_XORI);
+		source = right ? user.rs : user.rt;
+		break;
+
+	case I_SLT: case I_SLTU:
+		if(!right || !fitsSigned(k)) {
+			return false;
+		}
+		op = (user.op == I_SLT) ? I_SLTI : I_SLTIU;
+		source = user.rs;
+		break;
+
+	case I_SLLV: case I_SRLV: case I_SRAV:
+		// only the low five bits of the amount count
+		if(!right) {
+			return false;
+		}
+		op = (user.op == I_SLLV) ? I_SLL : ((user.op == I_SRLV) ? I_SRL : I_SRA);
+		source = user.rs;
+		k = k & 31;
+		break;
+
+	default:
+		return false;
+	}
+
+	Instruction i = {op, RELOC_NONE, user.rd, (Register)source, 0, (int)k, NO_SYMBOL};
+	user = i;
+	w.erase(1);
+	return true;
+}
+
+// op r, ...  =>  when nothing reads r afterwards
+static bool deadResult(Window &w) {
+	Instruction &i = w.at(0);
+	if(!isPure(i.op) || i.rd == REG_ZERO || (w.liveAt(0) & registerBit(i.rd))) {
+		return false;
+	}
+	w.erase(0);
+	return true;
+}
+
+// the widest window any rule looks at
+static const unsigned int WINDOW = 2;
+
+struct Rule {
+	unsigned int size;													// instructions in the window
+	bool (*apply)(Window &w);
+};
+
+// tried in this order, the first that matches wins
+static const Rule rules[] = {
+	{1, selfMove},
+	{1, deadResult},
+	{2, storeLoad},
+	{2, loadStore},
+	{2, storeStore},
+	{2, loadLoad},
+	{2, forwardMove},
+	{2, retarget},
+	{2, zeroConstant},
+	{2, immediateOperand}
+};
+
+static bool rewrite(Window &w) {
+
+	// delay slots stay where they are, whatever is in them: count how many
+	// of the newest instructions a window may cover
+	unsigned int n = w.code.size();
+	unsigned int reach = 0;
+	while(reach < n - w.fixed && reach < WINDOW) {
+		unsigned int i = n - 1 - reach;
+		if(i > 0 && hasDelaySlot(w.code[i - 1].op)) {
+			break;
+		}
+		reach++;
+	}
+
+	for(unsigned int r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+		if(rules[r].size <= reach && rules[r].apply(w)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// SLOTS
+
+// Stores to a variable slot nothing loads from. Variables never have their
+// address taken, so a slot is only read by lw off $fp.
+static unsigned int deadSlotStores(MachineFunction &fn) {
+
+	vector<bool> loaded;
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			if(code[i].op == I_LW && code[i].rs == REG_FP) {
+				unsigned int slot = -code[i].imm / 4;
+				if(slot >= loaded.size()) {
+					loaded.resize(slot + 1, false);
+				}
+				loaded[slot] = true;
+			}
+		}
+	}
+
+	unsigned int removed = 0;
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		vector<Instruction> &code = fn.blocks[b].code;
+		bool startsInSlot = (b > 0) && !fn.blocks[b - 1].code.empty() && isBranch(fn.blocks[b - 1].code.back().op);
+		unsigned int kept = 0;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			unsigned int slot = -code[i].imm / 4;
+			if(code[i].op == I_SW && code[i].rs == REG_FP && (slot >= loaded.size() || !loaded[slot])) {
+				removed++;
+				bool delaySlot = (i > 0) ? hasDelaySlot(code[i - 1].op) : startsInSlot;
+				if(!delaySlot) {
+					continue;
+				}
+				Instruction nop = {I_NOP, RELOC_NONE, 0, 0, 0, 0, NO_SYMBOL};
+				code[i] = nop;
+			}
+			code[kept++] = code[i];
+		}
+		code.resize(kept);
+	}
+	return removed;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// PASS
+
+unsigned int peephole(MachineFunction &fn) {
+
+	unsigned int total = 0;
+	unsigned int rewrites;
+
+	do {
+		rewrites = deadSlotStores(fn);
+		vector<unsigned int> live = fn.liveOut();
+
+		for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+			vector<Instruction> &code = fn.blocks[b].code;
+
+			Window w;
+			w.fixed = 0;
+			if(b > 0 && !fn.blocks[b - 1].code.empty() && isBranch(fn.blocks[b - 1].code.back().op)) {
+				// this block starts in the delay slot of the branch before
+				w.fixed = 1;
+			}
+
+			// slide over the block, going back over earlier instructions after each rewrite
+			vector<unsigned int> after;
+			fn.liveness(code, live[b], &after);
+			for(unsigned int i = 0; i < code.size(); i++) {
+				w.code.push_back(code[i]);
+				w.liveAfter.push_back(after[i]);
+				while(rewrite(w)) {
+					rewrites++;
+				}
+			}
+			code.swap(w.code);
+		}
+
+		total = total + rewrites;
+	} while(rewrites > 0);
+
+	return total;
+}
@@ -0,0 +1,15 @@
+#ifndef peephole_hpp
+#define peephole_hpp
+
+#include "mips.hpp"
+
+// Slide a small window over each block and rewrite what matches a rule:
+// loads of a value that was just stored, stores of a value that was just
+// loaded, moves that only rename a register, constants that fit in an
+// immediate and results nobody reads. Stores to variable slots that are
+// never loaded go as well. Runs until nothing changes and returns how many
+// rewrites were made.
+unsigned int peephole(MachineFunction &fn);
+
+
+#endif
@@ -0,0 +1,372 @@
+#include "regalloc.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+
+using namespace std;
+
+// what a virtual register can end up in, in order of preference
+static const unsigned int ANYWHERE[] = {8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23};
+static const unsigned int ACROSS_CALLS[] = {16, 17, 18, 19, 20, 21, 22, 23};
+
+// never handed out, spilled values are loaded into these
+static const unsigned int SCRATCH[] = {REG_T8, REG_T9};
+
+// an occurrence at loop depth d weighs WEIGHTS[d], deeper ones as much as the deepest here
+static const double WEIGHTS[] = {1, 10, 100, 1000, 10000, 100000};
+static const int MAX_DEPTH = 5;
+
+// Positions number the instructions of the function in order: instruction
+// i reads at 2i and writes at 2i+1, so a value read for the last time can
+// share its register with the value written by the same instruction.
+struct Interval {
+	unsigned int reg;													// virtual register
+	int start;
+	int end;
+	double cost;														// weighted number of reads and writes
+	bool crossesCall;													// live in and out of a jal
+	unsigned int hint;													// virtual register it is copied from, or NO_REGISTER
+	unsigned int assigned;												// physical register, or NO_REGISTER once spilled
+	int slot;															// offset from $fp when spilled
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// SETS
+
+// one bit per virtual register
+typedef vector<uint64_t> RegisterSet;
+
+static bool contains(const RegisterSet &s, unsigned int v) {
+	return (s[v >> 6] >> (v & 63)) & 1;
+}
+
+static void insert(RegisterSet &s, unsigned int v) {
+	s[v >> 6] = s[v >> 6] | (1ull << (v & 63));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// INTERVALS
+
+// the virtual registers an instruction reads, numbered from 0
+static unsigned int virtualSources(const Instruction &i, unsigned int *sources) {
+	unsigned int all[2];
+	unsigned int n = sourceRegisters(i, all);
+	unsigned int count = 0;
+	for(unsigned int k = 0; k < n; k++) {
+		if(all[k] >= FIRST_VIRTUAL) {
+			sources[count++] = all[k] - FIRST_VIRTUAL;
+		}
+	}
+	return count;
+}
+
+static unsigned int virtualDestination(const Instruction &i) {
+	unsigned int rd = destinationRegister(i);
+	return (rd != NO_REGISTER && rd >= FIRST_VIRTUAL) ? rd - FIRST_VIRTUAL : NO_REGISTER;
+}
+
+static void extend(Interval &interval, int position) {
+	interval.start = min(interval.start, position);
+	interval.end = max(interval.end, position);
+}
+
+// Build the live interval of every virtual register: from the first point it
+// is live to the last, holes included.
+static vector<Interval> buildIntervals(const MachineFunction &fn) {
+
+	unsigned int count = fn.virtualCount;
+	unsigned int words = (count + 63) / 64;
+	unsigned int blocks = fn.blocks.size();
+	vector<int> where = fn.labelBlocks();
+
+	vector<Interval> intervals(count);
+	for(unsigned int v = 0; v < count; v++) {
+		Interval interval = {FIRST_VIRTUAL + v, 0x7fffffff, -1, 0, false, NO_REGISTER, NO_REGISTER, 0};
+		intervals[v] = interval;
+	}
+
+	// loop depth of each block, every branch back to an earlier block closes a loop
+	vector<int> depth(blocks, 0);
+	for(unsigned int b = 0; b < blocks; b++) {
+		int next[2];
+		unsigned int n = fn.successors(b, where, next);
+		for(unsigned int k = 0; k < n; k++) {
+			for(int l = next[k]; l >= 0 && l <= (int)b; l++) {
+				depth[l]++;
+			}
+		}
+	}
+
+	// what each block reads before writing and what it writes, and where it starts
+	vector<RegisterSet> used(blocks, RegisterSet(words, 0));
+	vector<RegisterSet> defined(blocks, RegisterSet(words, 0));
+	vector<int> first(blocks + 1, 0);
+	vector<int> calls;
+	int position = 0;
+
+	for(unsigned int b = 0; b < blocks; b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		double weight = WEIGHTS[min(depth[b], MAX_DEPTH)];
+		first[b] = position;
+
+		for(unsigned int i = 0; i < code.size(); i++, position++) {
+			unsigned int sources[2];
+			unsigned int n = virtualSources(code[i], sources);
+			for(unsigned int k = 0; k < n; k++) {
+				if(!contains(defined[b], sources[k])) {
+					insert(used[b], sources[k]);
+				}
+				extend(intervals[sources[k]], 2 * position);
+				intervals[sources[k]].cost += weight;
+			}
+
+			unsigned int d = virtualDestination(code[i]);
+			if(d != NO_REGISTER) {
+				insert(defined[b], d);
+				extend(intervals[d], 2 * position + 1);
+				intervals[d].cost += weight;
+				if(code[i].op == I_MOVE && code[i].rs >= FIRST_VIRTUAL && intervals[d].hint == NO_REGISTER) {
+					intervals[d].hint = code[i].rs - FIRST_VIRTUAL;
+				}
+			}
+
+			if(code[i].op == I_JAL) {
+				calls.push_back(position);
+			}
+		}
+	}
+	first[blocks] = position;
+
+	// live on entry to and exit from each block, backwards to a fixed point
+	vector<RegisterSet> in(blocks, RegisterSet(words, 0));
+	vector<RegisterSet> out(blocks, RegisterSet(words, 0));
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		for(int b = blocks - 1; b >= 0; b--) {
+			int next[2];
+			unsigned int n = fn.successors(b, where, next);
+			for(unsigned int w = 0; w < words; w++) {
+				uint64_t live = 0;
+				for(unsigned int k = 0; k < n; k++) {
+					// nothing outside the function reads a virtual register
+					if(next[k] >= 0) {
+						live = live | in[next[k]][w];
+					}
+				}
+				out[b][w] = live;
+				live = used[b][w] | (live & ~defined[b][w]);
+				if(live != in[b][w]) {
+					in[b][w] = live;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	// stretch the intervals over the blocks they are live through
+	for(unsigned int b = 0; b < blocks; b++) {
+		if(first[b] == first[b + 1]) {
+			continue;
+		}
+		for(unsigned int w = 0; w < words; w++) {
+			for(uint64_t bits = in[b][w]; bits != 0; bits = bits & (bits - 1)) {
+				extend(intervals[64 * w + __builtin_ctzll(bits)], 2 * first[b]);
+			}
+			for(uint64_t bits = out[b][w]; bits != 0; bits = bits & (bits - 1)) {
+				extend(intervals[64 * w + __builtin_ctzll(bits)], 2 * first[b + 1] - 1);
+			}
+		}
+	}
+
+	// a value the callee may clobber has to be live on both sides of the jal
+	for(unsigned int v = 0; v < count; v++) {
+		Interval &interval = intervals[v];
+		vector<int>::const_iterator call = lower_bound(calls.begin(), calls.end(), (interval.start + 1) / 2);
+		interval.crossesCall = (call != calls.end()) && (2 * *call + 1 < interval.end);
+	}
+
+	return intervals;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// LINEAR SCAN
+
+static bool startsEarlier(const Interval *a, const Interval *b) {
+	return (a->start < b->start) || (a->start == b->start && a->reg < b->reg);
+}
+
+// the registers an interval may be given
+static const unsigned int *pool(const Interval &interval, unsigned int &size) {
+	if(interval.crossesCall) {
+		size = sizeof(ACROSS_CALLS) / sizeof(ACROSS_CALLS[0]);
+		return ACROSS_CALLS;
+	}
+	size = sizeof(ANYWHERE) / sizeof(ANYWHERE[0]);
+	return ANYWHERE;
+}
+
+static bool allowed(const Interval &interval, unsigned int reg) {
+	return !interval.crossesCall || (reg >= 16 && reg < 24);
+}
+
+// Give each interval a register, or NO_REGISTER where it has to live in memory.
+static void linearScan(vector<Interval> &intervals) {
+
+	vector<Interval *> order;
+	for(unsigned int v = 0; v < intervals.size(); v++) {
+		if(intervals[v].start <= intervals[v].end) {
+			order.push_back(&intervals[v]);
+		}
+	}
+	sort(order.begin(), order.end(), startsEarlier);
+
+	vector<Interval *> active;
+	Interval *holder[32] = {NULL};
+
+	for(unsigned int i = 0; i < order.size(); i++) {
+		Interval &current = *order[i];
+
+		// whatever has ended gives its register back
+		unsigned int kept = 0;
+		for(unsigned int a = 0; a < active.size(); a++) {
+			if(active[a]->end < current.start) {
+				holder[active[a]->assigned] = NULL;
+			} else {
+				active[kept++] = active[a];
+			}
+		}
+		active.resize(kept);
+
+		// the register of the value it is copied from if that just became free, else the first free one
+		unsigned int size;
+		const unsigned int *regs = pool(current, size);
+		unsigned int hint = NO_REGISTER;
+		if(current.hint != NO_REGISTER) {
+			hint = intervals[current.hint].assigned;
+		}
+		if(hint != NO_REGISTER && holder[hint] == NULL && allowed(current, hint)) {
+			current.assigned = hint;
+		}
+		for(unsigned int r = 0; r < size && current.assigned == NO_REGISTER; r++) {
+			if(holder[regs[r]] == NULL) {
+				current.assigned = regs[r];
+			}
+		}
+
+		if(current.assigned == NO_REGISTER) {
+			// keep whichever is cheapest to keep in memory there, ending last if it is a tie
+			Interval *victim = &current;
+			for(unsigned int a = 0; a < active.size(); a++) {
+				Interval *other = active[a];
+				if(!allowed(current, other->assigned)) {
+					continue;
+				}
+				if(other->cost < victim->cost || (other->cost == victim->cost && other->end > victim->end)) {
+					victim = other;
+				}
+			}
+			if(victim == &current) {
+				continue;
+			}
+			current.assigned = victim->assigned;
+			victim->assigned = NO_REGISTER;
+			active.erase(find(active.begin(), active.end(), victim));
+		}
+
+		holder[current.assigned] = &current;
+		active.push_back(&current);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////// REWRITING
+
+// put the physical register or the scratch register holding it wherever v appears in i
+static void rename(Instruction &i, unsigned int v, unsigned int reg) {
+	if(i.rd == v) {
+		i.rd = reg;
+	}
+	if(i.rs == v) {
+		i.rs = reg;
+	}
+	if(i.rt == v) {
+		i.rt = reg;
+	}
+}
+
+static Instruction slotAccess(Opcode op, unsigned int reg, int slot) {
+	Instruction i = {op, RELOC_NONE, (Register)reg, (Register)REG_FP, 0, slot, NO_SYMBOL};
+	return i;
+}
+
+void allocateRegisters(MachineFunction &fn) {
+
+	if(fn.virtualCount == 0) {
+		return;
+	}
+
+	vector<Interval> intervals = buildIntervals(fn);
+	linearScan(intervals);
+
+	// spill slots go below the variable slots, slot n being at -4n($fp)
+	int slot = 0;
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		for(unsigned int i = 0; i < code.size(); i++) {
+			if((code[i].op == I_LW || code[i].op == I_SW) && code[i].rs == REG_FP) {
+				slot = min(slot, code[i].imm - 4);
+			}
+		}
+	}
+	for(unsigned int v = 0; v < intervals.size(); v++) {
+		if(intervals[v].assigned == NO_REGISTER && intervals[v].start <= intervals[v].end) {
+			intervals[v].slot = slot;
+			slot = slot - 4;
+		}
+	}
+
+	// the code generator leaves delay slots empty, so no spill code lands in one
+	for(unsigned int b = 0; b < fn.blocks.size(); b++) {
+		const vector<Instruction> &code = fn.blocks[b].code;
+		vector<Instruction> rewritten;
+		rewritten.reserve(code.size());
+
+		for(unsigned int i = 0; i < code.size(); i++) {
+			Instruction instruction = code[i];
+			unsigned int sources[2];
+			unsigned int n = virtualSources(instruction, sources);
+			unsigned int d = virtualDestination(instruction);
+			unsigned int scratch = 0;
+			Register spilledDestination = NO_REGISTER;
+
+			for(unsigned int k = 0; k < n; k++) {
+				const Interval &interval = intervals[sources[k]];
+				if(interval.assigned != NO_REGISTER) {
+					rename(instruction, interval.reg, interval.assigned);
+				} else if(instruction.rd == interval.reg || instruction.rs == interval.reg || instruction.rt == interval.reg) {
+					// not loaded yet by an earlier source naming the same register
+					rewritten.push_back(slotAccess(I_LW, SCRATCH[scratch], interval.slot));
+					if(d == sources[k]) {
+						spilledDestination = SCRATCH[scratch];
+					}
+					rename(instruction, interval.reg, SCRATCH[scratch]);
+					scratch++;
+				}
+			}
+
+			if(d != NO_REGISTER && instruction.rd >= FIRST_VIRTUAL) {
+				const Interval &interval = intervals[d];
+				if(interval.assigned != NO_REGISTER) {
+					instruction.rd = interval.assigned;
+				} else {
+					spilledDestination = SCRATCH[0];
+					instruction.rd = SCRATCH[0];
+				}
+			}
+
+			rewritten.push_back(instruction);
+			if(d != NO_REGISTER && intervals[d].assigned == NO_REGISTER) {
+				rewritten.push_back(slotAccess(I_SW, spilledDestination, intervals[d].slot));
+			}
+		}
+
+		fn.blocks[b].code.swap(rewritten);
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef regalloc_hpp
+#define regalloc_hpp
+
+#include "mips.hpp"
+
+// Map the virtual registers of fn to $8-$23 by linear scan over their live
+// intervals. Values live across a call only get $16-$23, the rest try
+// $8-$15 first. When there are not enough registers the interval that is
+// cheapest to keep in memory, going by how often it is used and how deep in
+// loops, gets a frame slot instead and is loaded into $24 or $25 around
+// each use and stored after each definition.
+void allocateRegisters(MachineFunction &fn);
+
+
+#endif
@@ -0,0 +1,141 @@
+#include "symbol.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <stdlib.h>
+
+using namespace std;
+
+// must match the order of FixedSymbol
+static const char *fixedSpellings[S_FIXED_COUNT] = {
+	"int", "void",
+	"return", "if", "else", "while", "do", "for"
+};
+
+static unsigned int hashSpelling(const char *text, unsigned int len) {
+	// FNV-1a
+	unsigned int h = 2166136261u;
+	for(unsigned int i = 0; i < len; i++) {
+		h = (h ^ (unsigned char)text[i]) * 16777619u;
+	}
+	return h;
+}
+
+SymbolTable::SymbolTable()
+	: next(0)
+{
+	for(unsigned int i = 0; i < STRIPES; i++) {
+		stripes[i].buckets.resize(16);
+		stripes[i].count = 0;
+	}
+	for(unsigned int i = 0; i < MAX_CHUNKS; i++) {
+		chunks[i].store(NULL);
+	}
+	for(unsigned int i = 0; i < S_FIXED_COUNT; i++) {
+		intern(fixedSpellings[i], strlen(fixedSpellings[i]));
+	}
+}
+
+SymbolTable::~SymbolTable() {
+	for(unsigned int i = 0; i < MAX_CHUNKS; i++) {
+		delete[] chunks[i].load();
+	}
+}
+
+std::string &SymbolTable::slot(Symbol s) {
+
+	unsigned int c = s >> CHUNK_BITS;
+	std::string *chunk = chunks[c].load(std::memory_order_acquire);
+
+	if(chunk == NULL) {
+		// first id in this chunk, another stripe may be racing to allocate it
+		lock_guard<mutex> guard(chunkLock);
+		chunk = chunks[c].load(std::memory_order_acquire);
+		if(chunk == NULL) {
+			chunk = new std::string[CHUNK_SIZE];
+			chunks[c].store(chunk, std::memory_order_release);
+		}
+	}
+
+	return chunk[s & (CHUNK_SIZE - 1)];
+}
+
+void SymbolTable::grow(Stripe &stripe) {
+	vector<Entry> old(stripe.buckets.size() * 2);
+	old.swap(stripe.buckets);
+
+	unsigned int mask = stripe.buckets.size() - 1;
+	for(unsigned int j = 0; j < old.size(); j++) {
+		if(old[j].id != 0) {
+			unsigned int i = (old[j].hash / STRIPES) & mask;
+			while(stripe.buckets[i].id != 0) {
+				i = (i + 1) & mask;
+			}
+			stripe.buckets[i] = old[j];
+		}
+	}
+}
+
+Symbol SymbolTable::intern(const char *text, unsigned int len) {
+
+	unsigned int h = hashSpelling(text, len);
+	Stripe &stripe = stripes[h % STRIPES];
+
+	lock_guard<mutex> guard(stripe.lock);
+
+	unsigned int mask = stripe.buckets.size() - 1;
+	unsigned int i = (h / STRIPES) & mask;
+
+	while(stripe.buckets[i].id != 0) {
+		Symbol id = stripe.buckets[i].id - 1;
+		if(stripe.buckets[i].hash == h) {
+			// ids in this stripe were written under its lock, so reading the spelling is safe
+			const std::string &s = name(id);
+			if((s.size() == len) && (memcmp(s.data(), text, len) == 0)) {
+				// already interned
+				return id;
+			}
+		}
+		i = (i + 1) & mask;
+	}
+
+	// new spelling
+	Symbol id = next.fetch_add(1);
+	if((id >> CHUNK_BITS) >= MAX_CHUNKS) {
+		cerr << "too many distinct identifiers" << endl;
+		exit(1);
+	}
+	slot(id).assign(text, len);
+	stripe.buckets[i].hash = h;
+	stripe.buckets[i].id = id + 1;
+	stripe.count++;
+
+	// keep load factor under 1/2
+	if(2 * stripe.count > stripe.buckets.size()) {
+		grow(stripe);
+	}
+
+	return id;
+}
+
+const std::string &SymbolTable::name(Symbol s) const {
+	return chunks[s >> CHUNK_BITS].load(std::memory_order_acquire)[s & (CHUNK_SIZE - 1)];
+}
+
+unsigned int SymbolTable::size() const {
+	return next.load();
+}
+
+static SymbolTable &table() {
+	// initialisation of a function-local static is thread safe
+	static SymbolTable t;
+	return t;
+}
+
+Symbol intern(const char *text, unsigned int len) {
+	return table().intern(text, len);
+}
+
+const std::string &spelling(Symbol s) {
+	return table().name(s);
+}
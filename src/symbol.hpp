@@ -0,0 +1,69 @@
+#ifndef symbol_hpp
+#define symbol_hpp
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// dense integer id for an interned spelling
+typedef unsigned int Symbol;
+
+// keywords interned up front (in this order) so the lexer can hand them out without hashing
+enum FixedSymbol : Symbol {
+	S_INT, S_VOID,
+	S_RET, S_IF, S_ELSE, S_WHILE, S_DO, S_FOR,
+	S_FIXED_COUNT
+};
+
+// placeholder for declarations that carry no type or name
+const Symbol NO_SYMBOL = 0xffffffff;
+
+// Shared by every compilation in the process. Interning is split over
+// independently locked stripes so concurrent scanners rarely contend, and
+// spellings live in fixed-size chunks that never move, so name() needs no lock.
+class SymbolTable {
+private:
+	static const unsigned int STRIPES = 64;
+	static const unsigned int CHUNK_BITS = 12;
+	static const unsigned int CHUNK_SIZE = 1 << CHUNK_BITS;
+	static const unsigned int MAX_CHUNKS = 1 << 16;
+
+	struct Entry {
+		unsigned int hash;
+		Symbol id;														// id+1 (0 is empty)
+	};
+
+	struct Stripe {
+		std::mutex lock;
+		std::vector<Entry> buckets;										// open addressing
+		unsigned int count;
+	};
+
+	Stripe stripes[STRIPES];
+
+	std::atomic<unsigned int> next;										// next free id
+	std::atomic<std::string *> chunks[MAX_CHUNKS];						// spelling of each symbol, indexed by id
+	std::mutex chunkLock;
+
+	std::string &slot(Symbol s);
+	void grow(Stripe &stripe);
+
+public:
+	SymbolTable();
+	~SymbolTable();
+
+	Symbol intern(const char *text, unsigned int len);
+
+	const std::string &name(Symbol s) const;
+
+	unsigned int size() const;
+
+};
+
+// the table shared by the lexer, the AST and the code generator
+Symbol intern(const char *text, unsigned int len);
+const std::string &spelling(Symbol s);
+
+
+#endif
@@ -0,0 +1,151 @@
+#include "threadpool.hpp"
+
+using namespace std;
+
+// index of the worker running on this thread, -1 outside the pool
+static thread_local int workerIndex = -1;
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: pending(0), nextQueue(0), helpers(0), stopping(false)
+{
+	if(threads == 0) {
+		threads = 1;
+	}
+	for(unsigned int i = 0; i < threads; i++) {
+		queues.push_back(new Queue());
+	}
+	for(unsigned int i = 0; i < threads; i++) {
+		workers.push_back(thread(&ThreadPool::run, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(unsigned int i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	for(unsigned int i = 0; i < queues.size(); i++) {
+		delete queues[i];
+	}
+}
+
+unsigned int ThreadPool::size() const {
+	return workers.size();
+}
+
+void ThreadPool::submit(const function<void()> &task) {
+	
+	unsigned int q;
+	if(workerIndex >= 0) {
+		q = workerIndex;
+	} else {
+		q = nextQueue.fetch_add(1) % queues.size();
+	}
+	
+	pending.fetch_add(1);
+	{
+		lock_guard<mutex> guard(queues[q]->lock);
+		queues[q]->tasks.push_back(task);
+	}
+	
+	{
+		// taking the lock orders this against a worker about to sleep
+		lock_guard<mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait() {
+	unique_lock<mutex> guard(sleepLock);
+	while(pending.load() != 0) {
+		finished.wait(guard);
+	}
+}
+
+bool ThreadPool::popLocal(int self, function<void()> &task) {
+	if(self < 0) {
+		return false;
+	}
+	lock_guard<mutex> guard(queues[self]->lock);
+	if(queues[self]->tasks.empty()) {
+		return false;
+	}
+	task = queues[self]->tasks.back();
+	queues[self]->tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::steal(int self, function<void()> &task) {
+	// threads outside the pool start with queue 0 and may take from all of them
+	unsigned int first = (self < 0) ? 0 : 1;
+	unsigned int start = (self < 0) ? 0 : self;
+	for(unsigned int i = first; i < queues.size(); i++) {
+		Queue *victim = queues[(start + i) % queues.size()];
+		lock_guard<mutex> guard(victim->lock);
+		if(!victim->tasks.empty()) {
+			// oldest task, the one its owner will get to last
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::execute(function<void()> &task) {
+	task();
+	task = nullptr;
+	if((pending.fetch_sub(1) == 1) || (helpers.load() != 0)) {
+		lock_guard<mutex> guard(sleepLock);
+		finished.notify_all();
+	}
+}
+
+void ThreadPool::runUntil(const atomic<unsigned int> &remaining) {
+	function<void()> task;
+	while(remaining.load() != 0) {
+		if(popLocal(workerIndex, task) || steal(workerIndex, task)) {
+			execute(task);
+		} else {
+			// what is left is running elsewhere, sleep until some task ends
+			unique_lock<mutex> guard(sleepLock);
+			helpers.fetch_add(1);
+			if(remaining.load() != 0) {
+				finished.wait(guard);
+			}
+			helpers.fetch_sub(1);
+		}
+	}
+}
+
+void ThreadPool::run(unsigned int self) {
+	
+	workerIndex = self;
+	function<void()> task;
+	
+	while(true) {
+		if(popLocal(self, task) || steal(self, task)) {
+			execute(task);
+			continue;
+		}
+		
+		unique_lock<mutex> guard(sleepLock);
+		if(stopping) {
+			return;
+		}
+		// recheck under the lock so a submit between the scan and here is not missed
+		bool empty = true;
+		for(unsigned int i = 0; i < queues.size() && empty; i++) {
+			lock_guard<mutex> qguard(queues[i]->lock);
+			empty = queues[i]->tasks.empty();
+		}
+		if(empty) {
+			wake.wait(guard);
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef threadpool_hpp
+#define threadpool_hpp
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Fixed set of worker threads, each with its own task deque. A worker pops
+// from the back of its own deque and, when that runs dry, steals from the
+// front of another worker's deque, so uneven tasks still keep every core busy.
+class ThreadPool {
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<std::function<void()> > tasks;
+	};
+	
+	std::vector<Queue*> queues;
+	std::vector<std::thread> workers;
+	
+	std::atomic<unsigned int> pending;									// submitted but not yet finished
+	std::atomic<unsigned int> nextQueue;								// round robin for tasks from outside the pool
+	std::atomic<unsigned int> helpers;									// threads sleeping in runUntil
+	
+	std::mutex sleepLock;
+	std::condition_variable wake;										// work arrived or pool stopping
+	std::condition_variable finished;									// pending reached zero, or a task ended while helpers wait
+	bool stopping;
+	
+	bool popLocal(int self, std::function<void()> &task);
+	bool steal(int self, std::function<void()> &task);
+	void execute(std::function<void()> &task);
+	void run(unsigned int self);
+	
+public:
+	ThreadPool(unsigned int threads);
+	~ThreadPool();
+	
+	unsigned int size() const;
+	
+	// queue a task, on the caller's own deque when called from a worker
+	void submit(const std::function<void()> &task);
+	
+	// block until every submitted task has finished
+	void wait();
+	
+	// run queued tasks on the calling thread until remaining drops to zero,
+	// so a task waiting for tasks it spawned keeps its thread busy instead of blocking it
+	void runUntil(const std::atomic<unsigned int> &remaining);
+	
+};
+
+
+#endif
@@ -0,0 +1,20 @@
+int calls = 10;
+
+int count(int v) {
+	calls++;
+	return v;
+}
+
+int andor(int a, int b) {
+	int n = 0;
+	if ((a < b) && (count(b) < 10)) {
+		n = n + 1;
+	}
+	if ((a == 3) || (count(a) > 100)) {
+		n = n + 10;
+	}
+	if ((a > b) && (count(a) > 0)) {
+		n = n + 100;
+	}
+	return (n + calls);
+}
@@ -0,0 +1,6 @@
+int andor(int a, int b);
+
+int main()
+{
+    return !( 22 == andor(3, 5) );
+}
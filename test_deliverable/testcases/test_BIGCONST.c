@@ -0,0 +1,10 @@
+int bigconst(int n) {
+	int x = 0;
+	int s = 0;
+	while (n > 0) {
+		s = s + x;
+		x = 70000;
+		n--;
+	}
+	return s;
+}
@@ -0,0 +1,6 @@
+int bigconst(int n);
+
+int main()
+{
+    return !( 140000 == bigconst(3) );
+}
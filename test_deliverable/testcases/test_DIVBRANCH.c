@@ -0,0 +1,8 @@
+int divbranch(int a, int b, int c) {
+	int x = a / b;
+	int y = c / b;
+	if (a < c) {
+		return 0;
+	}
+	return x;
+}
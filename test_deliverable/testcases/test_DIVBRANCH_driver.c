@@ -0,0 +1,6 @@
+int divbranch(int a, int b, int c);
+
+int main()
+{
+    return !( 14 == divbranch(100, 7, 5) );
+}
@@ -0,0 +1,7 @@
+int divconst(int a) {
+	int b = a / 8;
+	int c = a / -3;
+	int d = a / 7;
+	int e = a % 7;
+	return (((b + c) + d) + e);
+}
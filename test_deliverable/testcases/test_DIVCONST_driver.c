@@ -0,0 +1,6 @@
+int divconst(int a);
+
+int main()
+{
+    return !( ( 5 == divconst(-100) ) && ( -5 == divconst(100) ) );
+}
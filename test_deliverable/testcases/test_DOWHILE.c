@@ -0,0 +1,8 @@
+int dowhile(int n) {
+	int s = 0;
+	do {
+		s = s + n;
+		n--;
+	} while (n > 0);
+	return s;
+}
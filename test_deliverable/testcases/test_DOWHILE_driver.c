@@ -0,0 +1,6 @@
+int dowhile(int n);
+
+int main()
+{
+    return !( ( 10 == dowhile(4) ) && ( 0 == dowhile(0) ) && ( -3 == dowhile(-3) ) );
+}
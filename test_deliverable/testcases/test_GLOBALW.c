@@ -0,0 +1,12 @@
+int x = 10;
+
+int setx(int a) {
+	x = a;
+	return 0;
+}
+
+int globalw(int a) {
+	setx(a);
+	x++;
+	return x;
+}
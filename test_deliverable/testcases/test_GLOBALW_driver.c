@@ -0,0 +1,6 @@
+int globalw(int a);
+
+int main()
+{
+    return !( 8 == globalw(7) );
+}
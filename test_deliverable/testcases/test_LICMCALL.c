@@ -0,0 +1,12 @@
+int twice(int v) {
+	return (v + v);
+}
+
+int licmcall(int a, int b) {
+	int s = 0;
+	int i;
+	for (i = 0; i < b; i++) {
+		s = s + ((a * 3) + twice(i));
+	}
+	return s;
+}
@@ -0,0 +1,6 @@
+int licmcall(int a, int b);
+
+int main()
+{
+    return !( ( 72 == licmcall(5, 4) ) && ( 0 == licmcall(5, 0) ) );
+}
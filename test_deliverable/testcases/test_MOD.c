@@ -0,0 +1,4 @@
+int modulo(int a)
+{
+    return a%10;
+}
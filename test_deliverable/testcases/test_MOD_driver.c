@@ -0,0 +1,6 @@
+int modulo(int a);
+
+int main()
+{
+    return !( -7 == modulo(-127) );
+}
@@ -0,0 +1,7 @@
+int mulconst(int a) {
+	int b = a * -4;
+	int c = a * 8;
+	int d = a * 10;
+	int e = a * -7;
+	return (((b + c) + d) + e);
+}
@@ -0,0 +1,6 @@
+int mulconst(int a);
+
+int main()
+{
+    return !( ( 21 == mulconst(3) ) && ( -42 == mulconst(-6) ) );
+}
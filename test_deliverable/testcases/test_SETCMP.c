@@ -0,0 +1,6 @@
+int setcmp(int a, int b) {
+	int ge = (a >= b);
+	int le = (a <= b);
+	int no = !a;
+	return (((ge * 100) + (le * 10)) + no);
+}
@@ -0,0 +1,6 @@
+int setcmp(int a, int b);
+
+int main()
+{
+    return !( ( 110 == setcmp(5, 5) ) && ( 11 == setcmp(0, 3) ) && ( 100 == setcmp(4, -2) ) );
+}
@@ -0,0 +1,11 @@
+int unroll(int n, int k) {
+	int s = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		s = s + (i * k);
+	}
+	for (i = 100; i > 3; i--) {
+		s = s + i;
+	}
+	return s;
+}
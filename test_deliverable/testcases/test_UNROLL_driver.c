@@ -0,0 +1,6 @@
+int unroll(int n, int k);
+
+int main()
+{
+    return !( ( 5086 == unroll(7, 2) ) && ( 5044 == unroll(0, 2) ) && ( 5122 == unroll(13, 1) ) );
+}